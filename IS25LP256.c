@@ -1,6 +1,6 @@
 //
 // Flash Memory IS25LP256 Access Library for RaspberryPi
-// Using wiringPi library for SPI control
+// Using /dev/spidev ioctl for SPI control (spidev.c)
 //
 
 #include <stdio.h>
@@ -9,8 +9,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <wiringPiSPI.h>
+#include "spidev.h"
 #include "IS25LP256.h"
+#include "rt.h"
+#include "util.h"
 
 #define CMD_NORD              0x03    // Normal Read Mode
 #define CMD_FRD               0x0B    // Fast Read Mode
@@ -26,6 +28,11 @@
 
 #define CMD_RDJDID            0x9F    // Read JEDEC ID
 #define CMD_RDUID             0x4B    // Read Unique ID
+#define CMD_RDSFDP            0x5A    // Read SFDP
+
+#define CMD_NORD4             0x13    // Normal Read Mode with 4-byte address
+#define CMD_FRD4              0x0C    // Fast Read Mode with 4-byte address
+#define CMD_PP4               0x12    // Input Page Program with 4-byte address
 
 #define SR_BUSY_MASK	      0x01    // Status Register의 Bit0(WIP) 선택을 위한 마스크 (Write In Progress Bit), 0 device ready, 1 device busy
 #define SR_WEN_MASK	          0x02    // Status Register의 Bit1(WEL) 선택을 위한 마스크 (Write Enable Latch), 0 not write enabled, 1 write enabled
@@ -33,7 +40,8 @@
 
 #define UNUSED(a) ((void)(a))
 
-static uint8_t _spich;
+static uint32_t _cmd_hz;     // 명령 전송용 clock (0: SPIDEV_open 시의 기본값)
+static uint32_t _data_hz;    // 대용량 데이터 전송용 clock (0: 기본값)
 
 void spcDump(char *id,int rc, uint8_t *data,int len) {
     int i;
@@ -47,9 +55,32 @@ void spcDump(char *id,int rc, uint8_t *data,int len) {
 
 //
 // 플래시 메모리 IS25LP256 사용 시작
-// 
-void IS25LP256_begin(uint8_t spich) {
-    _spich = spich;
+// dev(in) : spidev device 이름 (ex. /dev/spidev0.0)
+// mode(in) : SPI mode (0 ~ 3)
+// speed_hz(in) : 기본 clock 속도. 명령/데이터 clock 은 IS25LP256_setClock() 으로 따로 지정 가능
+// 반환값: true:정상 종료 false:실패
+//
+bool IS25LP256_begin(const char* dev, uint8_t mode, uint32_t speed_hz) {
+  _cmd_hz = 0;
+  _data_hz = 0;
+  return SPIDEV_open(dev, mode, speed_hz);
+}
+
+//
+// 플래시 메모리 IS25LP256 사용 종료
+//
+void IS25LP256_end(void) {
+  SPIDEV_close();
+}
+
+//
+// 전송 clock 지정
+// cmd_hz(in) : 명령, 상태 레지스터 등 작은 전송의 clock (0: 기본값)
+// data_hz(in) : read / page program 데이터 구간의 clock (0: 기본값)
+//
+void IS25LP256_setClock(uint32_t cmd_hz, uint32_t data_hz) {
+  _cmd_hz = cmd_hz;
+  _data_hz = data_hz;
 }
 
 //
@@ -61,7 +92,7 @@ uint8_t IS25LP256_readStatusReg(void) {
   int rc;
   UNUSED(rc);
   data[0] = CMD_RDSR;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("readStatusReg",rc,data,2);
   return data[1];
 }
@@ -76,7 +107,7 @@ void IS25LP256_readManufacturer(uint8_t* d) {
   UNUSED(rc);
   memset(data,0,sizeof(data));
   data[0] = CMD_RDJDID;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("readManufacturer",rc,data,4);
   memcpy(d,&data[1],3);
 }
@@ -91,7 +122,7 @@ void IS25LP256_readUniqieID(uint8_t* d) {
   UNUSED(rc);
   memset(data,0,sizeof(data));
   data[0] = CMD_RDUID;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("readUniqieID",rc,data,21);
   memcpy(d,&data[5],16);
 }
@@ -105,7 +136,7 @@ bool IS25LP256_IsBusy(void) {
   int rc;
   UNUSED(rc);
   data[0] = CMD_RDSR;                    // 05h    Byte0
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("IsBusy",rc,data,2);
   uint8_t r1;
   r1 = data[1];                          // Status register 값    Byte1
@@ -121,7 +152,7 @@ void IS25LP256_powerDown(void) {
   int rc;
   UNUSED(rc);
   data[0] = CMD_DP;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("powerDown",rc,data,1);
 }
 
@@ -133,7 +164,7 @@ void IS25LP256_WriteEnable(void) {
   int rc;
   UNUSED(rc);
   data[0] = CMD_WREN;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("WriteEnable",rc,data,1);
 }
 
@@ -145,83 +176,362 @@ void IS25LP256_WriteDisable(void) {
   int rc;
   UNUSED(rc);
   data[0] = CMD_WRDI;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  rc = SPIDEV_transfer(data,data,sizeof(data),_cmd_hz);
   //spcDump("WriteDisable",rc,data,1);
 }
 
 //
-// 데이터 읽기 Normal Read Mode (NORD)
-// addr(in): 읽기 시작 주소 (범위: 24비트 0x000000 - 0x1FFFFFFF)
-// n(in): 읽기 데이터 수
+// 칩 프로파일 공통 처리
+// 주소 byte 수(ABYTES)와 opcode 가 상수로 전달되므로 컴파일러가 프로파일마다
+// 특화된 함수를 만들어 준다. (호출 시 주소 모드에 따른 분기가 없음)
 //
-uint16_t IS25LP256_read(uint32_t addr,uint8_t *buf,uint16_t n){ 
-  unsigned char *data;
+static inline __attribute__((always_inline))
+uint8_t putAddr(unsigned char* p, uint32_t addr, uint8_t abytes) {
+  uint8_t i = 0;
+  if (abytes == 4) p[i++] = (addr>>24) & 0xFF;   // A31-A24
+  p[i++] = (addr>>16) & 0xFF;                    // A23-A16
+  p[i++] = (addr>>8) & 0xFF;                     // A15-A08
+  p[i++] = addr & 0xFF;                          // A07-A00
+  return i;
+}
+
+static inline __attribute__((always_inline))
+uint32_t chipRead(uint8_t op, uint8_t abytes, uint8_t dummy, uint32_t addr, uint8_t* buf, uint32_t n) {
+  unsigned char cmd[6];
+  uint8_t hlen = 1 + abytes + dummy;
+  uint32_t chunk = SPIDEV_maxTransfer() - hlen;    // spidev 1회 전송 최대 크기
+  uint32_t done = 0;
+  int rc;
+
+  while (done < n) {
+    uint32_t len = n - done;
+    if (len > chunk) len = chunk;
+    cmd[0] = op;
+    putAddr(&cmd[1], addr, abytes);
+    if (dummy) cmd[1+abytes] = 0;   // Dummy byte
+    rc = SPIDEV_transfer2(cmd,hlen,_cmd_hz,NULL,&buf[done],len,_data_hz);    // Data는 buf에 바로 받음
+    if (rc < 0) break;
+    done += len;
+    addr += len;
+  }
+  return done;
+}
+
+static inline __attribute__((always_inline))
+int chipProgram(uint8_t op, uint8_t abytes, uint32_t addr, const uint8_t* buf, uint16_t n) {
+  unsigned char cmd[5];
   int rc;
 
-  data = (unsigned char*)malloc(n+4);
-  data[0] = CMD_NORD;              // 03h        Byte0
-  data[1] = (addr>>16) & 0xFF;     // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xFF;      // A15-A08    Byte2
-  data[3] = addr & 0xFF;           // A07-A00    Byte3
-  rc = wiringPiSPIDataRW (_spich,data,n+4);    //Data read from Byte4
-  //spcDump("read",rc,data,rc);
-  memcpy(buf,&data[4],n);
-  free(data);
-  return rc-4;
+  // 쓰기 권한 설정
+  IS25LP256_WriteEnable();
+  if (IS25LP256_IsBusy()) return 0;      // 다른 일을 하고 있어서 Busy 상태면 멈춤
+
+  cmd[0] = op;
+  putAddr(&cmd[1], addr, abytes);
+  rc = SPIDEV_transfer2(cmd,1+abytes,_cmd_hz,buf,NULL,n,_data_hz);    // 데이터는 buf에서 바로 전송 (복사 없음)
+  if (rc < 0) return 0;
+
+  // 처리 대기
+  while(IS25LP256_IsBusy()) ;
+  return rc;
+}
+
+static inline __attribute__((always_inline))
+bool chipErase(uint8_t op, uint8_t abytes, uint32_t addr) {
+  unsigned char cmd[5];
+
+  // 쓰기 권한 설정
+  IS25LP256_WriteEnable();
+
+  cmd[0] = op;
+  putAddr(&cmd[1], addr, abytes);
+  return SPIDEV_transfer(cmd,NULL,1+abytes,_cmd_hz) >= 0;
+}
+
+// 프로파일별 특화 함수 정의
+#define DEFINE_CHIP_OPS(tag, ABYTES, RD, FRD, PP) \
+  static uint32_t tag##_read(uint32_t addr, uint8_t* buf, uint32_t n) { return chipRead(RD, ABYTES, 0, addr, buf, n); } \
+  static uint32_t tag##_fastread(uint32_t addr, uint8_t* buf, uint32_t n) { return chipRead(FRD, ABYTES, 1, addr, buf, n); } \
+  static int tag##_program(uint32_t addr, const uint8_t* buf, uint16_t n) { return chipProgram(PP, ABYTES, addr, buf, n); } \
+  static bool tag##_erase(uint8_t op, uint32_t addr) { return chipErase(op, ABYTES, addr); }
+
+DEFINE_CHIP_OPS(addr3, 3, CMD_NORD, CMD_FRD, CMD_PP)        // ~16MB, 3-byte address
+DEFINE_CHIP_OPS(addr4, 4, CMD_NORD4, CMD_FRD4, CMD_PP4)     // 32MB~, dedicated 4-byte address opcodes
+
+#define MB (1024*1024)
+#define PROFILE_ADDR3 3, CMD_NORD, CMD_FRD, CMD_PP
+#define PROFILE_ADDR4 4, CMD_NORD4, CMD_FRD4, CMD_PP4
+#define OPS_ADDR3 addr3_read, addr3_fastread, addr3_program, addr3_erase
+#define OPS_ADDR4 addr4_read, addr4_fastread, addr4_program, addr4_erase
+#define ERR_ISSI  0x81, 0x82, 0x08      // RDERP/CLERP, E_ERR (extended read register bit3)
+#define ERR_MXIC  0x2B, 0x00, 0x40      // RDSCUR, E_FAIL (security register bit6)
+#define ERR_NONE  0x00, 0x00, 0x00      // no error flags, only the SPI transfer is checked
+
+//
+// 알려진 칩 목록 (JEDEC ID, 크기, opcode, 데이터시트 typical 시간)
+// 16MB 를 넘는 칩은 4-byte 주소 전용 opcode 를 사용한다.
+// (4-byte 모드(B7h)로 바꾸지 않으므로 FPGA 부팅에는 영향이 없음)
+//
+static const struct flash_profile _profiles[] = {
+  // name         JEDEC ID          size    page  addr/opcodes   SE    BE32  BE64   tSE tBE32 tBE64 tCE  error flags ops
+  { "IS25LP256", {0x9D,0x60,0x19}, 32*MB, 256, PROFILE_ADDR4, 0x21, 0x5C, 0xDC,  70, 100, 150, 45, ERR_ISSI, OPS_ADDR4 },
+  { "IS25LP128", {0x9D,0x60,0x18}, 16*MB, 256, PROFILE_ADDR3, 0x20, 0x52, 0xD8,  70, 100, 150, 45, ERR_ISSI, OPS_ADDR3 },
+  { "IS25LP064", {0x9D,0x60,0x17},  8*MB, 256, PROFILE_ADDR3, 0x20, 0x52, 0xD8,  70, 100, 150, 30, ERR_ISSI, OPS_ADDR3 },
+  { "W25Q256",   {0xEF,0x40,0x19}, 32*MB, 256, PROFILE_ADDR4, 0x21, 0x00, 0xDC,  45, 120, 150, 80, ERR_NONE, OPS_ADDR4 },
+  { "W25Q128",   {0xEF,0x40,0x18}, 16*MB, 256, PROFILE_ADDR3, 0x20, 0x52, 0xD8,  45, 120, 150, 40, ERR_NONE, OPS_ADDR3 },
+  { "W25Q64",    {0xEF,0x40,0x17},  8*MB, 256, PROFILE_ADDR3, 0x20, 0x52, 0xD8,  45, 120, 150, 20, ERR_NONE, OPS_ADDR3 },
+  { "MX25L256",  {0xC2,0x20,0x19}, 32*MB, 256, PROFILE_ADDR4, 0x21, 0x5C, 0xDC,  40, 150, 300, 80, ERR_MXIC, OPS_ADDR4 },
+  { "MX25L128",  {0xC2,0x20,0x18}, 16*MB, 256, PROFILE_ADDR3, 0x20, 0x52, 0xD8,  40, 150, 300, 50, ERR_MXIC, OPS_ADDR3 },
+};
+
+static struct flash_profile _sfdp_profile;           // SFDP 로 만든 프로파일
+static const struct flash_profile* _chip = &_profiles[0];   // 선택된 칩 프로파일, 기본값: IS25LP256 (IS25LP256_detect)
+
+// SFDP 로 만든 프로파일용 (알 수 없는 칩). 프로파일 값을 실행 시에 참조한다.
+static uint32_t generic_read(uint32_t addr, uint8_t* buf, uint32_t n) {
+  return chipRead(_chip->cmd_read, _chip->addr_bytes, 0, addr, buf, n);
+}
+static uint32_t generic_fastread(uint32_t addr, uint8_t* buf, uint32_t n) {
+  return chipRead(_chip->cmd_fastread, _chip->addr_bytes, 1, addr, buf, n);
+}
+static int generic_program(uint32_t addr, const uint8_t* buf, uint16_t n) {
+  return chipProgram(_chip->cmd_pp, _chip->addr_bytes, addr, buf, n);
+}
+static bool generic_erase(uint8_t op, uint32_t addr) {
+  return chipErase(op, _chip->addr_bytes, addr);
+}
+
+
+//
+// SFDP 읽기 (Serial Flash Discoverable Parameters)
+// addr(in): SFDP 주소 (항상 3-byte 주소 + dummy 1 byte)
+//
+uint16_t IS25LP256_readSFDP(uint32_t addr, uint8_t* buf, uint16_t n) {
+  return chipRead(CMD_RDSFDP, 3, 1, addr, buf, n);
+}
+
+static uint32_t dword(const uint8_t* p) {
+  return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+//
+// SFDP 에서 프로파일 만들기 (JESD216)
+// Basic Flash Parameter Table(ID FF00h) 와 4-byte Address Instruction Table(ID FF84h)을 사용
+// 반환값: true:정상 종료 false:SFDP 없음
+//
+static bool parseSFDP(const uint8_t* jedec, struct flash_profile* p) {
+  uint8_t hdr[8 + 8*8];
+  uint8_t bfpt[16*4];
+  uint8_t t4b[2*4];
+  uint32_t bfpt_ptr = 0, bfpt_len = 0, t4b_ptr = 0;
+  uint8_t nph, i;
+
+  IS25LP256_readSFDP(0, hdr, sizeof(hdr));
+  if (memcmp(hdr, "SFDP", 4) != 0) return false;
+  nph = hdr[6] + 1;                      // number of parameter headers
+  if (nph > 8) nph = 8;
+  for (i = 0; i < nph; i++) {
+    const uint8_t* ph = &hdr[8 + i*8];
+    uint16_t id = ph[0] | (ph[7]<<8);
+    uint32_t ptr = ph[4] | (ph[5]<<8) | (ph[6]<<16);
+    if (id == 0xFF00 && bfpt_ptr == 0) { bfpt_ptr = ptr; bfpt_len = ph[3] * 4; }
+    if (id == 0xFF84) t4b_ptr = ptr;
+  }
+  if (bfpt_ptr == 0 || bfpt_len < 9*4) return false;
+  if (bfpt_len > sizeof(bfpt)) bfpt_len = sizeof(bfpt);
+  memset(bfpt, 0, sizeof(bfpt));
+  IS25LP256_readSFDP(bfpt_ptr, bfpt, bfpt_len);
+
+  memset(p, 0, sizeof(*p));
+  p->name = "SFDP";
+  memcpy(p->jedec, jedec, 3);
+
+  // DWORD2: density
+  uint32_t d2 = dword(&bfpt[4]);
+  if (d2 & 0x80000000) p->size = ((d2 & 0x7FFFFFFF) >= 35) ? 0 : (uint32_t)(1ULL << ((d2 & 0x7FFFFFFF) - 3));
+  else p->size = (d2 + 1) / 8;
+  if (p->size == 0) return false;
+
+  // DWORD8, DWORD9: erase types (size 2^N, opcode)
+  uint8_t et_size[4], et_op[4];
+  for (i = 0; i < 4; i++) {
+    et_size[i] = bfpt[7*4 + i*2];
+    et_op[i] = bfpt[7*4 + i*2 + 1];
+    if (et_size[i] == 12) p->cmd_se = et_op[i];
+    if (et_size[i] == 15) p->cmd_be32 = et_op[i];
+    if (et_size[i] == 16) p->cmd_be64 = et_op[i];
+  }
+  if (p->cmd_se == 0) {
+    uint32_t d1 = dword(&bfpt[0]);
+    if ((d1 & 0x03) != 0x01) return false;   // 4KB erase 가 없으면 사용할 수 없음
+    p->cmd_se = (d1 >> 8) & 0xFF;
+  }
+
+  // DWORD11: page size 2^N (JESD216A 이후), 없으면 256byte
+  p->page_size = 256;
+  if (bfpt_len >= 11*4) p->page_size = 1 << ((bfpt[10*4] >> 4) & 0x0F);
+  if (p->page_size > 256 || p->page_size < 16) p->page_size = 256;
+
+  p->addr_bytes = 3;
+  p->cmd_read = CMD_NORD;
+  p->cmd_fastread = CMD_FRD;
+  p->cmd_pp = CMD_PP;
+  if (p->size > 16*MB) {
+    // 4-byte 주소 전용 opcode 가 모두 있을 때만 사용한다
+    if (t4b_ptr == 0) return false;
+    IS25LP256_readSFDP(t4b_ptr, t4b, sizeof(t4b));
+    uint32_t s = dword(&t4b[0]);
+    if (!(s & (1<<0)) || !(s & (1<<1)) || !(s & (1<<6))) return false;
+    p->addr_bytes = 4;
+    p->cmd_read = CMD_NORD4;
+    p->cmd_fastread = CMD_FRD4;
+    p->cmd_pp = CMD_PP4;
+    uint32_t ops = dword(&t4b[4]);
+    uint8_t se = 0, be32 = 0, be64 = 0;
+    for (i = 0; i < 4; i++) {
+      if (!(s & (1 << (9+i)))) continue;
+      if (et_size[i] == 12) se = (ops >> (i*8)) & 0xFF;
+      if (et_size[i] == 15) be32 = (ops >> (i*8)) & 0xFF;
+      if (et_size[i] == 16) be64 = (ops >> (i*8)) & 0xFF;
+    }
+    if (se == 0) return false;
+    p->cmd_se = se;
+    p->cmd_be32 = be32;
+    p->cmd_be64 = be64;
+  }
+
+  // 시간은 보수적인 값 사용 (polling 간격에만 사용함)
+  p->t_se_ms = 50;
+  p->t_be32_ms = 100;
+  p->t_be64_ms = 150;
+  p->t_ce_s = 30;
+
+  p->read = generic_read;
+  p->fastread = generic_fastread;
+  p->program = generic_program;
+  p->erase = generic_erase;
+  return true;
+}
+
+//
+// 칩 인식
+// JEDEC ID 와 SFDP 를 읽어서 프로파일을 선택한다.
+// 알려진 칩은 특화된 프로파일, 모르는 칩은 SFDP 로 만든 프로파일을 사용한다.
+// 반환값: 선택된 프로파일, 인식 실패시 NULL (기본 프로파일 유지)
+//
+const struct flash_profile* IS25LP256_detect(void) {
+  uint8_t jedec[3];
+  struct flash_profile sfdp;
+  bool has_sfdp;
+  uint8_t i;
+
+  IS25LP256_readManufacturer(jedec);
+  has_sfdp = parseSFDP(jedec, &sfdp);
+
+  for (i = 0; i < sizeof(_profiles)/sizeof(_profiles[0]); i++) {
+    if (memcmp(_profiles[i].jedec, jedec, 3) == 0) {
+      if (has_sfdp && sfdp.size != _profiles[i].size) {
+        printf("IS25LP256_detect: SFDP size %u does not match %s\n", sfdp.size, _profiles[i].name);
+        return NULL;
+      }
+      _chip = &_profiles[i];
+      return _chip;
+    }
+  }
+  if (!has_sfdp) return NULL;
+  _sfdp_profile = sfdp;
+  _chip = &_sfdp_profile;
+  return _chip;
+}
+
+//
+// 현재 사용 중인 프로파일
+//
+const struct flash_profile* IS25LP256_profile(void) {
+  return _chip;
+}
+
+//
+// 데이터 읽기 Normal Read Mode (NORD)
+// addr(in): 읽기 시작 주소 (범위: 0x0000000 - 0x1FFFFFF)
+// n(in): 읽기 데이터 수
+//
+uint32_t IS25LP256_read(uint32_t addr,uint8_t *buf,uint32_t n){ 
+  return _chip->read(addr, buf, n);
 }
 
 //
 // 고속 데이터 읽기 Fast Read Mode (FRD)
-// addr(in): 읽기 시작 주소 (24비트 0x000000 - 0x1FFFFFFF)
+// 프로파일에서 지원하는 가장 빠른 읽기 명령을 사용 (1xSPI)
+// addr(in): 읽기 시작 주소 (범위: 0x0000000 - 0x1FFFFFF)
 // n(in): 읽기 데이터 수
 //
-uint16_t IS25LP256_fastread(uint32_t addr,uint8_t *buf,uint16_t n) {
-  unsigned char *data;
-  int rc;
+uint32_t IS25LP256_fastread(uint32_t addr,uint8_t *buf,uint32_t n) {
+  return _chip->fastread(addr, buf, n);
+}
+
+//
+// 지우기 실패 확인 (칩의 error flag, flag 가 없는 칩은 항상 성공)
+// 반환값: true:정상 false:지우기 실패
+//
+static bool eraseOk(void) {
+  unsigned char data[2];
 
-  data = (unsigned char*)malloc(n+5);
-  data[0] = CMD_FRD;               // 0Bh        Byte0
-  data[1] = (addr>>16) & 0xFF;     // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xFF;      // A15-A08    Byte2
-  data[3] = addr & 0xFF;           // A07-A00    Byte3
-  data[4] = 0;                     // Dummy byte Byte4
-  rc = wiringPiSPIDataRW (_spich,data,n+5);    //Data read from Byte5
-  //spcDump("fastread",rc,data,rc);
-  memcpy(buf,&data[5],n);        // data[5]부터 n byte를 읽어서 buf에 복사한다
-  free(data);
-  return rc-5;
+  if (_chip->cmd_rderr == 0) return true;
+  data[0] = _chip->cmd_rderr;
+  data[1] = 0;
+  if (SPIDEV_transfer(data,data,sizeof(data),_cmd_hz) < 0) return false;
+  if (!(data[1] & _chip->err_erase)) return true;
+  if (_chip->cmd_clrerr) {                   // sticky flag 는 다음 지우기 전에 지운다
+    data[0] = _chip->cmd_clrerr;
+    SPIDEV_transfer(data,NULL,1,_cmd_hz);
+  }
+  return false;
+}
+
+//
+// 지우기 완료 대기
+// typical 시간 동안 먼저 기다린 다음, typical 시간의 1/10 간격으로 Status register 확인
+// 반환값: true:정상 false:칩이 지우기 실패를 보고함
+//
+static bool waitErase(uint32_t typ_ms) {
+  usleep(typ_ms * 1000);
+  while(IS25LP256_IsBusy()) {
+    usleep(typ_ms * 100);
+  }
+  return eraseOk();
+}
+
+//
+// 지우기 명령이 없는 크기를 섹터 지우기 n 개로 (마지막 섹터만 flgwait 에 따름)
+//
+static bool eraseSectors(uint32_t addr, uint8_t n, bool flgwait) {
+  uint8_t i;
+  for (i = 0; i < n; i++) {
+    if (!IS25LP256_eraseSector((addr>>12) + i, (i + 1 < n) ? true : flgwait)) return false;
+  }
+  return true;
 }
 
 //
 // 섹터 단위 지우기(4kb 단위로 데이터 지우기)
 // sect_no(in) 섹터 번호(0 - 8191)
 // flgwait(in) true: 처리 대기 false: 대기 없음
-// 반환값: true:정상 종료 false:실패
+// 반환값: true:정상 종료 false:실패 (전송 실패, flgwait 이면 칩의 지우기 실패 flag 도 확인)
 // 추가: 데이터시트에는 지우기에 보통 100ms ~ 300ms 걸린다고 명시되어 있다.
-//       주소 24비트 중 상위 12비트가 섹터 번호에 해당한다.
+//       주소의 상위 비트가 섹터 번호에 해당한다.
 //       하위 12비트는 섹터 내 주소가 된다. (4kB 단위이기 때문임)
 //       지우기 전에 Write Enable해야 함.
 //       섹터 지우기가 끝나면, Status register의 WEL bit는 자동으로 reset됨
-
 //
 bool IS25LP256_eraseSector(uint16_t sect_no, bool flgwait) {
-  unsigned char data[4];
-  int rc;
-  UNUSED(rc);
   uint32_t addr = sect_no;        // Erase할 Sector 번호 (0 ~ 8191)
   addr<<=12;                      // 왼쪽으로 12bit 밀어야 실제 주소가 만들어짐
 
-  IS25LP256_WriteEnable();        // Write Enable 설정해야 함
-  data[0] = CMD_SER;              // 20h        Byte0
-  data[1] = (addr>>16) & 0xff;    // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xff;     // A15-A08    Byte2
-  data[3] = addr & 0xff;          // A07-A00    Byte3
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  if (!_chip->erase(_chip->cmd_se, addr)) return false;    // Write Enable 포함
  
   // 처리 대기
-  while(IS25LP256_IsBusy() & flgwait) {
-    usleep(10000);    // 10msec 마다 체크 (100~300msec 소요)
-  }
+  if (flgwait) return waitErase(_chip->t_se_ms);
   return true;
 }
 
@@ -231,31 +541,21 @@ bool IS25LP256_eraseSector(uint16_t sect_no, bool flgwait) {
 // flgwait(in) true:처리 대기 false:대기 없음
 // 반환값: true:정상 종료 false:실패
 // 추가: 데이터시트에는 지우기에 140ms ~ 500ms 걸린다고 명시되어 있다.
-//       주소 24비트 중 상위 9비트가 블록 번호에 해당한다.
+//       주소의 상위 비트가 블록 번호에 해당한다.
 //       하위 15 비트는 블록 내 주소가 된다. (32kB 단위이기 때문임)
 //       지우기 전에 Write Enable해야 함.
-//       섹터 지우기가 끝나면, Status register의 WEL bit는 자동으로 reset됨
+//       32KB 지우기 명령이 없는 칩은 섹터 8개를 지운다.
 //
 bool IS25LP256_erase32Block(uint16_t blk32_no, bool flgwait) {
-  unsigned char data[4];
-  int rc;
-  UNUSED(rc);
   uint32_t addr = blk32_no;       // Erase할 Block(32KB) 번호 (0 ~ 1023)
   addr<<=15;                      // 왼쪽으로 15bit 밀어야 실제 주소가 만들어짐
 
-  // 쓰기 권한 설정
-  IS25LP256_WriteEnable();  
+  if (_chip->cmd_be32 == 0) return eraseSectors(addr, 8, flgwait);
 
-  data[0] = CMD_BER32;            // 52h        Byte0
-  data[1] = (addr>>16) & 0xff;    // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xff;     // A15-A08    Byte2
-  data[3] = addr & 0xff;          // A07-A00    Byte3
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  if (!_chip->erase(_chip->cmd_be32, addr)) return false;
  
   // 처리 대기
-  while(IS25LP256_IsBusy() & flgwait) {
-    usleep(50000);    // 50msec 마다 체크 (140~500msec 소요)
-  }
+  if (flgwait) return waitErase(_chip->t_be32_ms);
   return true;
 }
 
@@ -265,31 +565,21 @@ bool IS25LP256_erase32Block(uint16_t blk32_no, bool flgwait) {
 // flgwait(in) true: 처리 대기 false: 대기 없음
 // 반환값: true:정상 종료 false:실패
 // 보충: 데이터시트에는 지우기에 170ms ~ 1000ms 걸린다고 명시되어 있다.
-//       주소 24비트 중 상위 8비트가 블록 번호에 해당한다.
+//       주소의 상위 비트가 블록 번호에 해당한다.
 //       하위 16비트는 블록 내 주소가 된다. (64kB 단위이기 때문임)
 //       지우기 전에 Write Enable해야 함.
-//       섹터 지우기가 끝나면, Status register의 WEL bit는 자동으로 reset됨
+//       64KB 지우기 명령이 없는 칩은 섹터 16개를 지운다.
 //
 bool IS25LP256_erase64Block(uint16_t blk64_no, bool flgwait) {
-  unsigned char data[4];
-  int rc;
-  UNUSED(rc);
   uint32_t addr = blk64_no;       // Erase할 Block(64kB) 번호 (0 ~ 511)
   addr<<=16;                      // 왼쪽으로 16bit 밀어야 실제 주소가 만들어짐
 
-  // 쓰기 권한 설정
-  IS25LP256_WriteEnable();
+  if (_chip->cmd_be64 == 0) return eraseSectors(addr, 16, flgwait);
 
-  data[0] = CMD_BER64;            // D8h        Byte0
-  data[1] = (addr>>16) & 0xff;    // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xff;     // A15-A08    Byte2
-  data[3] = addr & 0xff;          // A07-A00    Byte3
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  if (!_chip->erase(_chip->cmd_be64, addr)) return false;
  
   // 처리 대기
-  while(IS25LP256_IsBusy() & flgwait) {
-    usleep(50000);    // 50msec 마다 체크 (170 ~ 1000msec 소요)
-  }
+  if (flgwait) return waitErase(_chip->t_be64_ms);
   return true;
 }
 
@@ -298,60 +588,67 @@ bool IS25LP256_erase64Block(uint16_t blk64_no, bool flgwait) {
 // 전체 영역 지우기 Chip Erase
 // flgwait(in) true:처리 대기 false:대기 없음
 // 반환값: true:정상 종료 false:실패
-// 추가: 데이터시트에는 지우는데 70s ~ 180s 걸린다고 명시되어 있다.
+// 추가: typical 시간은 프로파일의 t_ce_s (IS25LP256 45s), 최대 시간은 그 몇 배이다.
 //
 bool IS25LP256_eraseAll(bool flgwait) {
   unsigned char data[1];
-  int rc;
-  UNUSED(rc);
 
   // 쓰기 권한 설정
   IS25LP256_WriteEnable();  
 
   data[0] = CMD_CER;
-  rc = wiringPiSPIDataRW (_spich,data,sizeof(data));
+  if (SPIDEV_transfer(data,data,sizeof(data),_cmd_hz) < 0) return false;
+  if (!flgwait) return true;
 
   // 처리 대기
-  while(IS25LP256_IsBusy() & flgwait) {
-    sleep(1);        // 1sec마다 체크. 실제로 전체 지우는데 1~3분 걸리므로 한참 돌 것이다.
+  sleep(_chip->t_ce_s);
+  while(IS25LP256_IsBusy()) {
+    sleep(1);        // 1sec마다 체크 (typical 시간이 지난 뒤)
   }
-  return true;
+  return eraseOk();
 }
 
 //
 // 데이터 쓰기
-// sect_no(in) : 섹터 번호(0 - 8191, 0x000 - 0x1FF) 
+// sect_no(in) : 섹터 번호(0 - 8191, 0x000 - 0x1FFF) 
 // inaddr(in) : 섹터 내 주소(0 - 4095, 0x000 - 0xFFF)
 // buf(in) : 쓰는 데이터값의 시작 주소(포인터)
-// data(in) : 쓰기 데이터 저장 주소
-// n(in) : 쓰기 바이트 수(0~256 범위)
+// n(in) : 쓰기 바이트 수(0~page size 범위)
 //
 uint16_t IS25LP256_pageWrite(uint16_t sect_no, uint16_t inaddr, uint8_t* buf, uint16_t n) {
     // 섹터 번호, 섹터 내 주소값, 쓸 데이터의 최초 포인터, 쓸 데이터 갯수(byte 단위)
-  if (n > 256) return 0;    // Input Page Program(PP) 명령은 한번에 최대 256byte까지만 쓸 수 있음
-
-  unsigned char *data;
-  int rc;
+  if (n > _chip->page_size) return 0;    // Input Page Program(PP) 명령은 한번에 최대 page size(256byte)까지만 쓸 수 있음
 
   uint32_t addr = sect_no;
   addr<<=12;         // Sector 번호는 12bit 왼쪽으로 밀고,
   addr += inaddr;    // 섹터내 주소를 더하면 최종 주소 만들어짐
 
-  // 쓰기 권한 설정
-  IS25LP256_WriteEnable();  
-  if (IS25LP256_IsBusy()) return 0;      // 다른 일을 하고 있어서 Busy 상태면 멈춤
-
-  data = (unsigned char*)malloc(n+4);    // 쓸 데이터 갯수에 4 byte 추가 (CMD + 3byte 주소)
-  data[0] = CMD_PP;                      // D8h        Byte0
-  data[1] = (addr>>16) & 0xff;           // A23-A16    Byte1
-  data[2] = (addr>>8) & 0xff;            // A15-A08    Byte2
-  data[3] = addr & 0xff;                 // A07-A00    Byte3
-  memcpy(&data[4],buf,n);
-  rc = wiringPiSPIDataRW (_spich,data,n+4);
-  //spcDump("pageWrite",rc,buf,n);
+  return _chip->program(addr, buf, n);
+}
 
-  // 처리 대기
-  while(IS25LP256_IsBusy()) ;
-  free(data);
-  return rc;
+//
+// 주소 지정 데이터 쓰기 (page 경계 자동 분할)
+// addr(in) : 쓰기 시작 주소
+// buf(in) : 쓰기 데이터
+// n(in) : 쓰기 바이트 수 (제한 없음)
+// 반환값: 쓴 바이트 수 (실패하면 거기까지)
+// 추가: 지우기는 하지 않는다. 지워진(0xFF) 영역 또는 1->0 변화만 있는 영역에 사용할 것
+//       page 마다 WREN, PP, status poll 까지의 전체 시간을 latency histogram (rt.h) 에 넣는다
+//
+uint32_t IS25LP256_write(uint32_t addr, const uint8_t* buf, uint32_t n) {
+  uint32_t done = 0;
+  uint64_t t0;
+  int r;
+
+  while (done < n) {
+    uint32_t len = _chip->page_size - (addr % _chip->page_size);   // 현재 page 의 남은 바이트
+    if (len > n - done) len = n - done;
+    t0 = UTIL_nowUs();
+    r = _chip->program(addr, &buf[done], len);
+    RT_latAdd(UTIL_nowUs() - t0);
+    if (r <= 0) break;
+    done += len;
+    addr += len;
+  }
+  return done;
 }
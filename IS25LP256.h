@@ -1,9 +1,42 @@
 //#include <arduino.h>
 //#include <SPI.h>
 
-// Begin of flash memory operation by specify SPI channel number.
-// For example 0, 1, or 2, usually 0 is used.
-void IS25LP256_begin(uint8_t cs);
+// Flash chip profile, selected by JEDEC ID and SFDP (IS25LP256_detect)
+// Known chips have statically specialized operations (no per-call branching on address mode).
+struct flash_profile {
+  const char* name;
+  uint8_t  jedec[3];        // Manufacture, Memory Type, Capacity
+  uint32_t size;            // total bytes
+  uint16_t page_size;       // maximum bytes of one page program
+  uint8_t  addr_bytes;      // 3 or 4 (4: dedicated 4-byte address opcodes)
+  uint8_t  cmd_read;        // normal read opcode
+  uint8_t  cmd_fastread;    // fastest read opcode on 1xSPI (8 dummy clocks)
+  uint8_t  cmd_pp;          // page program opcode
+  uint8_t  cmd_se;          // 4KB sector erase opcode
+  uint8_t  cmd_be32;        // 32KB block erase opcode (0: not supported)
+  uint8_t  cmd_be64;        // 64KB block erase opcode (0: not supported)
+  uint16_t t_se_ms;         // typical 4KB erase time
+  uint16_t t_be32_ms;       // typical 32KB erase time
+  uint16_t t_be64_ms;       // typical 64KB erase time
+  uint16_t t_ce_s;          // typical chip erase time
+  uint8_t  cmd_rderr;       // read program/erase error flags opcode (0: chip has no error flags)
+  uint8_t  cmd_clrerr;      // clear error flags opcode (0: cleared by the next program/erase)
+  uint8_t  err_erase;       // erase failure bit of the error flags
+  uint32_t (*read)(uint32_t addr, uint8_t* buf, uint32_t n);
+  uint32_t (*fastread)(uint32_t addr, uint8_t* buf, uint32_t n);
+  int      (*program)(uint32_t addr, const uint8_t* buf, uint16_t n);
+  bool     (*erase)(uint8_t cmd, uint32_t addr);
+};
+
+// Begin of flash memory operation by specify spidev device.
+// For example "/dev/spidev0.0" is used. mode and speed are set only once.
+bool IS25LP256_begin(const char* dev, uint8_t mode, uint32_t speed_hz);
+
+// End of flash memory operation (close spidev device)
+void IS25LP256_end(void);
+
+// Set SPI clock of command phase and data phase separately (0 means default speed)
+void IS25LP256_setClock(uint32_t cmd_hz, uint32_t data_hz);
 
 // Read status register
 uint8_t IS25LP256_readStatusReg(void);
@@ -11,6 +44,15 @@ uint8_t IS25LP256_readStatusReg(void);
 // Read JEDEC ID(Manufacture, Memory Type,Capacity)
 void IS25LP256_readManufacturer(uint8_t* d);
 
+// Read SFDP (Serial Flash Discoverable Parameters)
+uint16_t IS25LP256_readSFDP(uint32_t addr, uint8_t* buf, uint16_t n);
+
+// Detect chip by JEDEC ID and SFDP, and select its profile (NULL: unknown chip)
+const struct flash_profile* IS25LP256_detect(void);
+
+// Profile currently used (IS25LP256 until IS25LP256_detect() selects another one)
+const struct flash_profile* IS25LP256_profile(void);
+
 // Read Unique ID of the memory
 void IS25LP256_readUniqieID(uint8_t* d);
 
@@ -27,22 +69,27 @@ void IS25LP256_WriteEnable(void);
 void IS25LP256_WriteDisable(void);
 
 // Read data
-uint16_t IS25LP256_read(uint32_t addr,uint8_t *buf,uint16_t n);
+uint32_t IS25LP256_read(uint32_t addr,uint8_t *buf,uint32_t n);
 
 // Fast read data
-uint16_t IS25LP256_fastread(uint32_t addr,uint8_t *buf,uint16_t n);
+uint32_t IS25LP256_fastread(uint32_t addr,uint8_t *buf,uint32_t n);
 
 // Erase by sector
+// Return: false if the command could not be sent or, with flgwait, the chip reports an erase failure
 bool  IS25LP256_eraseSector(uint16_t sect_no, bool flgwait);
 
-// Erase by 64KB block
+// Erase by 64KB block (same return value as IS25LP256_eraseSector)
 bool  IS25LP256_erase64Block(uint16_t blk64_no, bool flgwait);
 
-// Erase by 32KB block
+// Erase by 32KB block (same return value as IS25LP256_eraseSector)
 bool  IS25LP256_erase32Block(uint16_t blk32_no, bool flgwait);
 
-// Erase all (Entire of memory to '1')
+// Erase all (Entire of memory to '1') (same return value as IS25LP256_eraseSector)
 bool  IS25LP256_eraseAll(bool flgwait);
 
 // Write data
 uint16_t IS25LP256_pageWrite(uint16_t sect_no, uint16_t inaddr, uint8_t* data, uint16_t n);
+
+// Write data of any length from any address, split at page boundaries (no erase)
+// Each page program is added to the latency histogram (RT_latAdd, rt.h).
+uint32_t IS25LP256_write(uint32_t addr, const uint8_t* buf, uint32_t n);
@@ -0,0 +1,198 @@
+//
+// Board control of CM4 carrier board (FPGA SPI bypass, sleep, FPGA reconfiguration)
+// GPIO is handled by libgpiod
+//
+// While GPIO 14 (ROM_UPDATE_EN) is high, SPI Flash is connected to CM4 and the FPGA
+// cannot use it. Bypass is set only around the actual SPI work and the offline
+// time of every window is measured.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gpiod.h>
+#include "board.h"
+#include "util.h"
+
+static struct gpiod_chip *_chip;
+static struct gpiod_line *_rom_update_en;
+static struct gpiod_line *_sleep_en;
+
+static uint64_t _bypass_start;        // usec
+static bool _bypass;
+static uint32_t _offline_total;
+
+//
+// GPIO line 취득 및 요청
+// output(in) true: 출력(초기값 val), false: 입력
+//
+static struct gpiod_line* requestLine(unsigned int offset, bool output, int val) {
+  struct gpiod_line *line;
+  int ret;
+
+  line = gpiod_chip_get_line(_chip, offset);
+  if (!line) {
+    perror("Failed to get GPIO line");
+    return NULL;
+  }
+  if (output) ret = gpiod_line_request_output(line, "gpio-control", val);
+  else ret = gpiod_line_request_input(line, "gpio-control");
+  if (ret < 0) {
+    perror("Failed to request GPIO line");
+    return NULL;
+  }
+  return line;
+}
+
+//
+// 보드 제어 시작
+// chipname(in) : GPIO chip 이름 (ex. gpiochip0)
+// 반환값: true:정상 종료 false:실패 (요청한 line은 모두 해제됨)
+//
+bool BOARD_open(const char* chipname) {
+  _chip = gpiod_chip_open_by_name(chipname);
+  if (!_chip) {
+    perror("Failed to open GPIO chip");
+    return false;
+  }
+
+  // ROM_UPDATE_EN low: FPGA keeps SPI Flash
+  _sleep_en = requestLine(GPIO_07_SLEEP_EN, true, 0);
+  _rom_update_en = requestLine(GPIO_14_ROM_UPDATE_EN, true, 0);
+  if (!_sleep_en || !_rom_update_en) {
+    BOARD_close();
+    return false;
+  }
+  _bypass = false;
+  _offline_total = 0;
+  return true;
+}
+
+//
+// 보드 제어 종료. bypass 중이면 먼저 해제한다.
+//
+void BOARD_close(void) {
+  if (_bypass) BOARD_bypassDisable();
+  if (_sleep_en) gpiod_line_release(_sleep_en);
+  if (_rom_update_en) gpiod_line_release(_rom_update_en);
+  if (_chip) gpiod_chip_close(_chip);
+  _sleep_en = _rom_update_en = NULL;
+  _chip = NULL;
+}
+
+void BOARD_setSleep(bool en) {
+  gpiod_line_set_value(_sleep_en, en ? 1 : 0);
+}
+
+//
+// SPI bypass 시작 (GPIO 14 High). 이 시점부터 FPGA는 Flash를 사용할 수 없다.
+//
+void BOARD_bypassEnable(void) {
+  if (_bypass) return;
+  gpiod_line_set_value(_rom_update_en, 1);   // Set line high (3.3V)
+  _bypass_start = UTIL_nowUs();
+  _bypass = true;
+}
+
+//
+// SPI bypass 종료 (GPIO 14 Low)
+// 반환값: 이번 bypass 동안 FPGA가 offline 이었던 시간(msec)
+//
+uint32_t BOARD_bypassDisable(void) {
+  uint32_t ms;
+
+  if (!_bypass) return 0;
+  gpiod_line_set_value(_rom_update_en, 0);   // Set line low (0V)
+  ms = (uint32_t)((UTIL_nowUs() - _bypass_start) / 1000);
+  _bypass = false;
+  _offline_total += ms;
+  return ms;
+}
+
+uint32_t BOARD_offlineTotal(void) {
+  return _offline_total;
+}
+
+//
+// BOARD_RECONFIG_ENV 에서 PROGRAM_B, INIT_B 번호 읽기 ("program_b,init_b")
+// 반환값: true:설정됨 false:없거나 형식 오류
+//
+static bool reconfigPins(unsigned int* program_b, unsigned int* init_b) {
+  const char* s = getenv(BOARD_RECONFIG_ENV);
+  char* end;
+
+  if (s == NULL || *s == 0) return false;
+  *program_b = strtoul(s, &end, 10);
+  if (end == s || *end != ',') goto bad;
+  s = end + 1;
+  *init_b = strtoul(s, &end, 10);
+  if (end == s || *end != 0 || *program_b == *init_b || *program_b == GPIO_14_ROM_UPDATE_EN ||
+      *init_b == GPIO_14_ROM_UPDATE_EN || *program_b == GPIO_07_SLEEP_EN || *init_b == GPIO_07_SLEEP_EN) goto bad;
+  return true;
+
+bad:
+  printf("%s=%s: expected program_b,init_b GPIO numbers\n", BOARD_RECONFIG_ENV, getenv(BOARD_RECONFIG_ENV));
+  return false;
+}
+
+bool BOARD_canReconfigure(void) {
+  unsigned int program_b, init_b;
+  return reconfigPins(&program_b, &init_b);
+}
+
+//
+// FPGA 재구성 (Flash에서 다시 load)
+// PROGRAM_B 를 Low로 내려 FPGA 구성 메모리를 지우고, INIT_B 가 Low가 되는 것을 확인한 뒤
+// PROGRAM_B 를 High로 올려서 INIT_B 가 High가 될 때까지 기다린다.
+// INIT_B 가 High가 되면 FPGA가 Flash에서 bitstream 을 읽기 시작한다.
+// timeout_ms(in) : INIT_B 대기 최대 시간
+// 반환값: true:정상 종료 false:실패
+//
+bool BOARD_reconfigure(uint32_t timeout_ms) {
+  struct gpiod_line *program_b, *init_b = NULL;
+  unsigned int program_b_no, init_b_no;
+  uint64_t start;
+  bool ok = false;
+
+  if (_bypass) {
+    printf("BOARD_reconfigure: SPI bypass is still enabled\n");
+    return false;
+  }
+  if (!reconfigPins(&program_b_no, &init_b_no)) {
+    printf("BOARD_reconfigure: %s is not set\n", BOARD_RECONFIG_ENV);
+    return false;
+  }
+  // 재구성할 때만 요청 (다른 용도로 쓰이는 pin 일 수 있음), PROGRAM_B High: 재구성 없음
+  program_b = requestLine(program_b_no, true, 1);
+  if (program_b) init_b = requestLine(init_b_no, false, 0);
+  if (!program_b || !init_b) goto end;
+
+  gpiod_line_set_value(program_b, 0);
+  start = UTIL_nowUs();
+  while (gpiod_line_get_value(init_b) != 0) {
+    if (UTIL_nowUs() - start > (uint64_t)timeout_ms * 1000) {
+      gpiod_line_set_value(program_b, 1);
+      printf("BOARD_reconfigure: INIT_B did not go low\n");
+      goto end;
+    }
+    usleep(100);
+  }
+  gpiod_line_set_value(program_b, 1);
+
+  start = UTIL_nowUs();
+  while (gpiod_line_get_value(init_b) != 1) {
+    if (UTIL_nowUs() - start > (uint64_t)timeout_ms * 1000) {
+      printf("BOARD_reconfigure: INIT_B did not go high\n");
+      goto end;
+    }
+    usleep(1000);
+  }
+  ok = true;
+
+end:
+  if (init_b) gpiod_line_release(init_b);
+  if (program_b) gpiod_line_release(program_b);
+  return ok;
+}
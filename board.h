@@ -0,0 +1,48 @@
+//
+// Board control of CM4 carrier board (FPGA SPI bypass, sleep, FPGA reconfiguration)
+// GPIO is handled by libgpiod
+//
+
+#define GPIO_CHIP "gpiochip0"
+#define GPIO_14_ROM_UPDATE_EN	14		// ROM_UPDATE_EN, High: CM4 owns SPI Flash (FPGA bypassed)
+#define GPIO_07_SLEEP_EN	07		// SLEEP_EN, High: clock power down
+
+// FPGA PROGRAM_B (output, active low) and INIT_B (input) are not wired to fixed CM4 pins on every
+// carrier revision, so they are given at run time, ex) FLASH_RECONFIG=5,6 (PROGRAM_B GPIO 5, INIT_B GPIO 6).
+// Without it the FPGA loads the new image at the next power cycle.
+#define BOARD_RECONFIG_ENV "FLASH_RECONFIG"
+
+#define SPI_MODE  0          // SPI mode among 0, 1, 2 or 3
+#define SPI_DEVICE "/dev/spidev0.0"  // SPI channel 0
+#define SPI_SPEED_HZ 10000000	// SPI clock speed at 10MHz
+#define SPI_CMD_HZ   10000000	// SPI clock of command/status transfers
+#define SPI_DATA_HZ  10000000	// SPI clock of read/page program data phase (can be raised independently)
+
+#define BOARD_RECONFIG_TIMEOUT_MS 2000   // maximum wait for INIT_B after PROGRAM_B pulse
+
+// Open GPIO chip and request ROM_UPDATE_EN and SLEEP_EN (both start low)
+bool BOARD_open(const char* chipname);
+
+// Release all requested lines and close GPIO chip
+void BOARD_close(void);
+
+// Set sleep enable (true: clock power down)
+void BOARD_setSleep(bool en);
+
+// Start SPI bypass (GPIO 14 high). FPGA is offline from here.
+void BOARD_bypassEnable(void);
+
+// End SPI bypass (GPIO 14 low)
+// Return: time FPGA was offline during this bypass window (msec)
+uint32_t BOARD_bypassDisable(void);
+
+// Total time FPGA was offline by all bypass windows since BOARD_open() (msec)
+uint32_t BOARD_offlineTotal(void);
+
+// PROGRAM_B and INIT_B are given by BOARD_RECONFIG_ENV (false: reconfiguration is not available)
+bool BOARD_canReconfigure(void);
+
+// Reload FPGA from flash: pulse PROGRAM_B low and wait INIT_B high.
+// The two lines are requested only during this call. SPI bypass must be disabled.
+// Return: true if FPGA accepted reconfiguration
+bool BOARD_reconfigure(uint32_t timeout_ms);
@@ -0,0 +1,159 @@
+//
+// Copy or move a region of SPI Flash to another address
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IS25LP256.h"
+#include "sha256.h"
+#include "copy.h"
+
+#define BLOCK_SIZE        65536
+#define SECTOR_SIZE       4096
+#define SECTORS_PER_BLOCK (BLOCK_SIZE / SECTOR_SIZE)
+#define PAGE_SIZE         256
+
+static uint8_t _src[BLOCK_SIZE];     // source data of one destination block
+static uint8_t _dst[BLOCK_SIZE];     // destination block (current contents, then new contents)
+
+//
+// 한 block 안의 구간 쓰기 (addr - addr+n 이 같은 64KB block 안)
+// 걸치는 섹터의 현재 내용을 읽고, 바뀌는 섹터만 데이터를 덮어써서 지우고 쓴다. 구간 밖 바이트는 그대로 유지.
+// written(out) : 지우고 쓴 섹터 수 (더함), skipped(out) : 이미 같아서 건너뛴 섹터 수 (더함)
+// 반환값: true:정상 종료 false:erase/program 실패
+//
+static bool putBlock(uint32_t addr, const uint8_t* data, uint32_t n, uint32_t* written, uint32_t* skipped) {
+  uint32_t blk = addr & ~(BLOCK_SIZE - 1), off = addr - blk;
+  uint32_t s0 = off / SECTOR_SIZE, s1 = (off + n - 1) / SECTOR_SIZE;
+  bool changed[SECTORS_PER_BLOCK];
+  uint32_t s, from, to, pg, k, cnt = 0;
+
+  IS25LP256_fastread(blk + s0 * SECTOR_SIZE, &_dst[s0 * SECTOR_SIZE], (s1 - s0 + 1) * SECTOR_SIZE);
+  for (s = s0; s <= s1; s++) {
+    from = (off > s * SECTOR_SIZE) ? off : s * SECTOR_SIZE;
+    to = (off + n < (s + 1) * SECTOR_SIZE) ? off + n : (s + 1) * SECTOR_SIZE;
+    changed[s] = memcmp(&_dst[from], &data[from - off], to - from) != 0;
+    if (!changed[s]) {
+      (*skipped)++;
+      continue;
+    }
+    memcpy(&_dst[from], &data[from - off], to - from);
+    cnt++;
+  }
+  if (cnt == 0) return true;
+
+  if (cnt == SECTORS_PER_BLOCK) {
+    if (!IS25LP256_erase64Block(blk / BLOCK_SIZE, true)) {
+      printf("COPY_region: erase failed at %08x\n", blk);
+      return false;
+    }
+  } else {
+    for (s = s0; s <= s1; s++) {
+      if (changed[s] && !IS25LP256_eraseSector(blk / SECTOR_SIZE + s, true)) {
+        printf("COPY_region: erase failed at %08x\n", blk + s * SECTOR_SIZE);
+        return false;
+      }
+    }
+  }
+  for (s = s0; s <= s1; s++) {
+    if (!changed[s]) continue;
+    for (pg = s * SECTOR_SIZE; pg < (s + 1) * SECTOR_SIZE; pg += PAGE_SIZE) {
+      for (k = 0; k < PAGE_SIZE && _dst[pg + k] == 0xFF; k++) ;
+      if (k < PAGE_SIZE && IS25LP256_write(blk + pg, &_dst[pg], PAGE_SIZE) != PAGE_SIZE) {
+        printf("COPY_region: program failed at %08x\n", blk + pg);
+        return false;
+      }
+    }
+  }
+  *written += cnt;
+  return true;
+}
+
+//
+// 구간을 0xFF 로 (move 후 원본 정리), 다시 읽어서 지워졌는지 확인
+// cleared(out) : 지운 섹터 수 (더함)
+// 반환값: true:정상 종료 false:실패
+//
+static bool clearRange(uint32_t addr, uint32_t len, uint32_t* cleared) {
+  uint32_t end = addr + len, n, k, skipped = 0;
+
+  memset(_src, 0xFF, BLOCK_SIZE);
+  for (; addr < end; addr += n) {
+    n = BLOCK_SIZE - addr % BLOCK_SIZE;
+    if (n > end - addr) n = end - addr;
+    if (!putBlock(addr, _src, n, cleared, &skipped)) return false;
+    IS25LP256_fastread(addr, _dst, n);
+    for (k = 0; k < n && _dst[k] == 0xFF; k++) ;
+    if (k < n) {
+      printf("COPY_region: clear failed at %08x\n", addr + k);
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// 복사 (필요하면 이동)
+// 대상 block 단위 chunk 로 나눠서, 원본 chunk 를 읽고 digest 를 기록한 다음 대상에 쓴다.
+// 대상이 원본보다 뒤에 겹치면 뒤쪽 chunk 부터 (memmove 와 같음), 아직 읽지 않은 원본을 덮어쓰지 않는다.
+// 마지막에 대상을 다시 읽어 chunk 별 digest 로 확인한다.
+//
+bool COPY_region(uint32_t src, uint32_t dst, uint32_t len, bool move, struct copy_stats* st) {
+  struct copy_stats tmp;
+  uint8_t (*digest)[SHA256_SIZE];
+  uint8_t d[SHA256_SIZE];
+  uint32_t first = dst / BLOCK_SIZE;
+  uint32_t nchunk = (dst + len - 1) / BLOCK_SIZE - first + 1;
+  bool backward = dst > src && dst < src + len;
+  uint32_t i, c, a, e, bad = 0;
+
+  if (st == NULL) st = &tmp;
+  memset(st, 0, sizeof(*st));
+  if (len == 0 || src == dst) return true;
+  digest = malloc((size_t)nchunk * SHA256_SIZE);
+  if (digest == NULL) return false;
+
+  for (i = 0; i < nchunk; i++) {
+    c = backward ? nchunk - 1 - i : i;
+    a = (first + c) * BLOCK_SIZE;
+    e = a + BLOCK_SIZE;
+    if (a < dst) a = dst;
+    if (e > dst + len) e = dst + len;
+    IS25LP256_fastread(src + (a - dst), _src, e - a);
+    SHA256_digest(_src, e - a, digest[c]);
+    if (!putBlock(a, _src, e - a, &st->written, &st->skipped)) {
+      free(digest);
+      return false;
+    }
+    if (i % 4 == 3) printf("Copied %u of %u KB\n", (i + 1) * (BLOCK_SIZE / 1024), nchunk * (BLOCK_SIZE / 1024));
+  }
+
+  // 검증
+  for (c = 0; c < nchunk; c++) {
+    a = (first + c) * BLOCK_SIZE;
+    e = a + BLOCK_SIZE;
+    if (a < dst) a = dst;
+    if (e > dst + len) e = dst + len;
+    IS25LP256_fastread(a, _dst, e - a);
+    SHA256_digest(_dst, e - a, d);
+    if (memcmp(d, digest[c], SHA256_SIZE) != 0) {
+      if (bad < 16) printf("Verify failed at %08x-%08x\n", a, e - 1);
+      bad++;
+    }
+  }
+  free(digest);
+  if (bad) return false;
+
+  // 이동: 대상과 겹치지 않는 원본 구간을 지운다
+  if (move) {
+    if (src < dst && !clearRange(src, ((src + len < dst) ? src + len : dst) - src, &st->cleared)) return false;
+    if (src + len > dst + len) {
+      uint32_t from = (src > dst + len) ? src : dst + len;
+      if (!clearRange(from, src + len - from, &st->cleared)) return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,22 @@
+//
+// Copy or move a region of SPI Flash to another address (slot promotion)
+//
+// Data is streamed through two 64KB buffers (source data, destination contents) one destination
+// block at a time, no file is needed. Destination sectors which already hold the data are skipped,
+// bytes around an unaligned destination are kept (read-modify-write of the boundary sectors).
+// Overlapping regions are handled like memmove (backward when destination is above source).
+// The result is checked against SHA-256 digests of the source data, taken while it was read.
+// Move: after the copy is verified, source bytes outside the destination are set to 0xFF and read back.
+// A failed erase or program stops the copy or move with an error.
+//
+
+struct copy_stats {
+  uint32_t written;              // destination sectors erased and programmed
+  uint32_t skipped;              // destination sectors which already matched
+  uint32_t cleared;              // source sectors cleared by move
+};
+
+// Copy (move: false) or move (move: true) len bytes from src to dst
+// st(out): statistics (NULL: not needed)
+// Return: true:success (verified) false:failure
+bool COPY_region(uint32_t src, uint32_t dst, uint32_t len, bool move, struct copy_stats* st);
@@ -0,0 +1,29 @@
+//
+// CRC-32 (IEEE 802.3), table driven
+// Used for key-value records and the sector baseline of the scrubber.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include "crc32.h"
+
+static uint32_t _table[256];
+
+static void makeTable(void) {
+  uint32_t i, c;
+  uint8_t k;
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (k = 0; k < 8; k++) c = (c >> 1) ^ (0xEDB88320 & (0 - (c & 1)));
+    _table[i] = c;
+  }
+}
+
+uint32_t CRC32_update(uint32_t crc, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+
+  if (_table[1] == 0) makeTable();
+  crc = ~crc;
+  while (len--) crc = _table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
@@ -0,0 +1,6 @@
+//
+// CRC-32 (IEEE 802.3, same as zlib crc32)
+//
+
+// Continue crc over data (start with crc 0). Return: new crc
+uint32_t CRC32_update(uint32_t crc, const void* data, size_t len);
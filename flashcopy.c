@@ -0,0 +1,101 @@
+//
+// Copy or move a region of SPI Flash to another address (copy.c)
+//
+//    sudo ./flashcopy [-m] src dst len
+//    ex) sudo ./flashcopy 0x800000 0x000000 0x3A0000     # promote update slot to golden slot
+//        sudo ./flashcopy -m 0x400000 0x800000 0x3A0000  # move, source is cleared to 0xFF
+//
+// One SPI bypass window, no file on disk. Destination sectors which already match are skipped.
+// Changed sectors (destination, and cleared source of a move) are adopted in the scrub baseline,
+// and dropped from it if the copy fails.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "copy.h"
+#include "scrub.h"
+#include "util.h"
+
+static void usage(void) {
+  printf("usage: flashcopy [-m] src dst len\n");
+}
+
+//
+// Main program
+//
+int main(int argc, char* argv[]) {
+  const struct flash_profile* chip;
+  struct copy_stats st;
+  struct timespec t0;
+  uint32_t src, dst, len, us, ms;
+  bool move = false;
+  int opt, rc = 1;
+
+  while ((opt = getopt(argc, argv, "m")) != -1) {
+    switch (opt) {
+    case 'm': move = true; break;
+    default: usage(); return 1;
+    }
+  }
+  if (argc - optind != 3) {
+    usage();
+    return 1;
+  }
+  src = strtoul(argv[optind], NULL, 0);
+  dst = strtoul(argv[optind + 1], NULL, 0);
+  len = strtoul(argv[optind + 2], NULL, 0);
+
+  if (!BOARD_open(GPIO_CHIP)) return 1;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    goto end_board;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+
+  BOARD_bypassEnable();
+  chip = IS25LP256_detect();
+  if (chip == NULL) {
+    printf("Unknown flash chip\n");
+    goto end_bypass;
+  }
+  if (len == 0 || (uint64_t)src + len > chip->size || (uint64_t)dst + len > chip->size) {
+    printf("Range is out of flash (%u bytes)\n", chip->size);
+    goto end_bypass;
+  }
+  printf("%s %08x-%08x to %08x\n", move ? "Move" : "Copy", src, src + len - 1, dst);
+  // 도중에 끊기거나 실패해도 예전 baseline 이 남지 않도록 먼저 빼 둔다
+  SCRUB_load(SCRUB_BASELINE, chip->size);
+  SCRUB_invalidate(dst, len);
+  if (move) SCRUB_invalidate(src, len);
+  SCRUB_save(SCRUB_BASELINE);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (COPY_region(src, dst, len, move, &st)) {
+    us = UTIL_elapsedUs(&t0);
+    printf("Done: %u sectors written, %u skipped (already equal)", st.written, st.skipped);
+    if (move) printf(", %u source sectors cleared", st.cleared);
+    printf("\n%u bytes in %u ms (%.2f MB/s), verified by SHA-256\n", len, us / 1000, us ? (double)len / us : 0.0);
+    // 다음 scrub 때 flash 에서 baseline 을 가져온다 (move 는 0xFF 로 지운 원본도, 대상과 겹치는 부분은 대상 데이터)
+    SCRUB_adopt(dst, len);
+    if (move) SCRUB_adopt(src, len);
+    SCRUB_save(SCRUB_BASELINE);
+    rc = 0;
+  } else {
+    printf("Copy failed\n");
+  }
+
+end_bypass:
+  ms = BOARD_bypassDisable();
+  printf("FPGA offline %u ms\n", ms);
+  IS25LP256_end();
+end_board:
+  BOARD_close();
+  return rc;
+}
@@ -0,0 +1,642 @@
+//
+// Persistent flasher daemon
+// Keeps SPI and GPIO handles open, keeps recently used images in memory, and runs
+// erase / program / verify / read jobs received over a local Unix socket.
+//
+//    sudo ./flashd [/run/flashd.sock]
+//    echo "PROGRAM SMI_v2.2_240613_1xSPI.bin 0 prio=5 reconfig=1" | sudo socat - UNIX-CONNECT:/run/flashd.sock
+//
+// Request (one line)
+//    ERASE   <addr> <len>                 [prio=N]
+//    PROGRAM <file.bin|file.pkg> [addr]   [prio=N] [reconfig=1]   (erase changed sectors, program, verify)
+//    VERIFY  <file.bin|file.pkg> [addr]   [prio=N]
+//    READ    <addr> <len> <outfile>       [prio=N]
+//    STATUS
+// Reply (lines)
+//    QUEUED <id>
+//    PROGRESS <id> <done> <total>
+//    DONE <id> OK|FAIL <message>
+//    ERR <message>
+//
+// Jobs are serialized on the device, higher prio first and FIFO within the same prio.
+// Each job runs in 64KB steps, so new requests are accepted and progress is streamed while it runs.
+// SPI bypass is enabled while the queue is not empty.
+// If the key-value store (kvflash) is found at start, ERASE/PROGRAM over it are rejected and its
+// garbage collection runs one sector at a time when the queue has been empty for KV_GC_IDLE_MS.
+// ERASE/PROGRAM keep the scrub baseline (scrub.h) up to date: the range is dropped from it when
+// the job starts, and erased/programmed blocks are put back as they succeed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "pkg.h"
+#include "kvstore.h"
+#include "scrub.h"
+#include "util.h"
+
+#define FLASHD_SOCKET  "/run/flashd.sock"
+#define MAX_CLIENTS    16
+#define MAX_JOBS       64
+#define IMAGE_CACHE    4            // number of images kept in memory
+#define STEP_SIZE      65536        // one job step (64KB block)
+#define SECTOR_SIZE    4096
+#define LINE_MAX_LEN   512
+#define OUT_MAX_LEN    16384        // replies queued for a slow client
+#define OUT_RESERVE    4096         // PROGRESS lines are dropped when less than this is free
+#define KV_GC_IDLE_MS  1000         // idle time before a key-value store collection step
+
+enum job_type { JOB_ERASE, JOB_PROGRAM, JOB_VERIFY, JOB_READ };
+static const char* _job_name[] = { "ERASE", "PROGRAM", "VERIFY", "READ" };
+
+struct image {
+  char     path[256];
+  time_t   mtime;
+  off_t    fsize;
+  uint32_t size;                   // image bytes
+  uint32_t padded;                 // image bytes padded to sector size (0xFF)
+  uint32_t target;                 // default flash address (package target offset, 0 for .bin)
+  uint8_t  jedec[3];               // expected JEDEC ID of a package (00 00 00: any chip)
+  uint32_t lru;
+  uint16_t refs;                   // queued or running jobs using the image (never evicted or reloaded while > 0)
+  uint8_t* data;
+};
+
+struct job {
+  bool     used;
+  uint32_t id;
+  int      prio;
+  uint32_t seq;                    // FIFO order within same prio
+  enum job_type type;
+  int      client;                 // client fd for progress, -1 if disconnected
+  uint32_t addr;
+  uint32_t len;
+  uint32_t pos;                    // bytes done
+  uint32_t bad;                    // sectors failed (verify)
+  const char* fail;                // erase/program failure ("erase", "program"), NULL if none
+  uint32_t fail_addr;              // flash address of the failure
+  bool     reconfig;
+  struct image* img;
+  FILE*    out;
+};
+
+struct client {
+  int  fd;
+  char line[LINE_MAX_LEN];
+  int  n;
+  char out[OUT_MAX_LEN];           // replies not yet sent (socket is non-blocking)
+  int  nout;
+};
+
+static volatile sig_atomic_t _stop;
+static struct client _clients[MAX_CLIENTS];
+static struct job _jobs[MAX_JOBS];
+static struct job* _cur;
+static struct image _images[IMAGE_CACHE];
+static uint32_t _next_id = 1, _seq, _tick;
+static bool _reconfig_pending;
+static const struct flash_profile* _chip;
+static bool _kv;                   // key-value store is open (last KV_SIZE of the chip)
+static uint8_t _buf[STEP_SIZE];
+
+static void onSignal(int sig) {
+  (void)sig;
+  _stop = 1;
+}
+
+static struct client* findClient(int fd) {
+  uint16_t i;
+  for (i = 0; fd >= 0 && i < MAX_CLIENTS; i++) {
+    if (_clients[i].fd == fd) return &_clients[i];
+  }
+  return NULL;
+}
+
+//
+// 쌓인 응답을 보낼 수 있는 만큼 보내기 (기다리지 않음)
+//
+static void flushClient(struct client* c) {
+  ssize_t w;
+
+  if (c->nout == 0) return;
+  w = send(c->fd, c->out, c->nout, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (w <= 0) return;                 // EAGAIN: 다음 POLLOUT 때, 끊긴 client 는 read 에서 정리
+  c->nout -= w;
+  memmove(c->out, &c->out[w], c->nout);
+}
+
+static void closeClient(struct client* c);
+
+//
+// client 로 한 줄 보내기 (client 가 없으면 무시)
+// FPGA 가 offline 인 동안 job 이 느린 client 때문에 멈추지 않도록, 큐에 넣고 non-blocking 으로 보낸다.
+// PROGRESS 는 다음 PROGRESS 가 대신하므로 큐의 여유가 OUT_RESERVE 보다 적으면 버린다.
+// 그 밖의 응답 (QUEUED, DONE, ERR ...) 은 버리지 않는다. 큐가 꽉 차서 넣을 수 없으면 읽지 않는 client 이므로 끊는다.
+//
+static void sendLine(int fd, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void sendLine(int fd, const char* fmt, ...) {
+  struct client* c = findClient(fd);
+  char line[LINE_MAX_LEN];
+  bool progress;
+  va_list ap;
+  int n;
+
+  if (c == NULL) return;
+  va_start(ap, fmt);
+  n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+  va_end(ap);
+  if (n < 0) return;
+  if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+  line[n++] = '\n';
+  progress = strncmp(line, "PROGRESS ", 9) == 0;
+  if (c->nout + n > OUT_MAX_LEN - (progress ? OUT_RESERVE : 0)) flushClient(c);
+  if (c->nout + n > OUT_MAX_LEN - (progress ? OUT_RESERVE : 0)) {
+    if (progress) return;
+    printf("Client %d does not read replies, disconnected\n", c->fd);
+    closeClient(c);
+    return;
+  }
+  memcpy(&c->out[c->nout], line, n);
+  c->nout += n;
+  flushClient(c);
+}
+
+//
+// 이미지 cache 에서 가져오기 (없거나 파일이 바뀌었으면 다시 읽음)
+// job 이 사용 중인(refs > 0) slot 은 비우거나 다시 읽지 않는다. 파일이 바뀌었으면 다른 slot 에 읽는다.
+// busy(out) : 사용 중이 아닌 slot 이 없어서 읽지 못함
+//
+static struct image* getImage(const char* path, bool* busy) {
+  struct image* img = NULL;
+  struct stat st;
+  uint16_t i;
+
+  *busy = false;
+  if (stat(path, &st) < 0) return NULL;
+  _tick++;
+  for (i = 0; i < IMAGE_CACHE; i++) {
+    if (_images[i].data && strcmp(_images[i].path, path) == 0) {
+      if (_images[i].mtime == st.st_mtime && _images[i].fsize == st.st_size) {
+        _images[i].lru = _tick;
+        return &_images[i];
+      }
+      if (_images[i].refs == 0) img = &_images[i];      // changed file, reload into same slot
+    }
+  }
+  if (img == NULL) {
+    for (i = 0; i < IMAGE_CACHE; i++) {
+      if (_images[i].refs > 0) continue;
+      if (_images[i].data == NULL) { img = &_images[i]; break; }
+      if (img == NULL || _images[i].lru < img->lru) img = &_images[i];
+    }
+  }
+  if (img == NULL) {
+    *busy = true;
+    return NULL;
+  }
+  free(img->data);
+  memset(img, 0, sizeof(*img));
+
+  if (PKG_isPackage(path)) {
+    struct pkg p;
+    if (!PKG_open(path, &p)) return NULL;
+    img->data = PKG_loadImage(&p);
+    img->size = p.hdr.image_size;
+    img->target = p.hdr.target_offset;
+    memcpy(img->jedec, p.hdr.jedec, 3);
+    PKG_close(&p);
+    if (img->data == NULL) return NULL;
+  } else {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) return NULL;
+    img->size = st.st_size;
+    img->data = (uint8_t*)malloc(((size_t)img->size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE);
+    if (img->data == NULL || fread(img->data, 1, img->size, fp) != img->size) {
+      fclose(fp);
+      free(img->data);
+      img->data = NULL;
+      return NULL;
+    }
+    fclose(fp);
+  }
+  img->padded = (img->size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+  memset(&img->data[img->size], 0xFF, img->padded - img->size);
+  strncpy(img->path, path, sizeof(img->path) - 1);
+  img->mtime = st.st_mtime;
+  img->fsize = st.st_size;
+  img->lru = _tick;
+  return img;
+}
+
+//
+// 요청 한 줄 처리
+//
+static void handleLine(struct client* c, char* line) {
+  char* tok[8];
+  char* save;
+  int ntok = 0;
+  struct job j;
+  uint16_t i;
+  bool busy;
+
+  for (char* t = strtok_r(line, " \t\r", &save); t && ntok < 8; t = strtok_r(NULL, " \t\r", &save)) {
+    tok[ntok++] = t;
+  }
+  if (ntok == 0) return;
+
+  if (strcmp(tok[0], "STATUS") == 0) {
+    for (i = 0; i < MAX_JOBS; i++) {
+      struct job* q = &_jobs[i];
+      if (!q->used) continue;
+      sendLine(c->fd, "JOB %u %s prio=%d %s %u/%u", q->id, _job_name[q->type], q->prio,
+               q == _cur ? "running" : "queued", q->pos, q->len);
+    }
+    sendLine(c->fd, "END");
+    return;
+  }
+
+  memset(&j, 0, sizeof(j));
+  j.client = c->fd;
+  // option (key=value) 은 뒤에서 떼어낸다
+  while (ntok > 1 && strchr(tok[ntok-1], '=')) {
+    ntok--;
+    if (strncmp(tok[ntok], "prio=", 5) == 0) j.prio = atoi(tok[ntok] + 5);
+    else if (strncmp(tok[ntok], "reconfig=", 9) == 0) j.reconfig = atoi(tok[ntok] + 9) != 0;
+  }
+
+  if (strcmp(tok[0], "ERASE") == 0 && ntok == 3) {
+    j.type = JOB_ERASE;
+    j.addr = strtoul(tok[1], NULL, 0);
+    j.len = strtoul(tok[2], NULL, 0);
+    if (j.addr % SECTOR_SIZE || j.len % SECTOR_SIZE) {
+      sendLine(c->fd, "ERR erase range must be sector aligned");
+      return;
+    }
+  } else if ((strcmp(tok[0], "PROGRAM") == 0 || strcmp(tok[0], "VERIFY") == 0) && (ntok == 2 || ntok == 3)) {
+    j.type = (tok[0][0] == 'P') ? JOB_PROGRAM : JOB_VERIFY;
+    j.img = getImage(tok[1], &busy);
+    if (j.img == NULL) {
+      if (busy) sendLine(c->fd, "ERR cache busy");
+      else sendLine(c->fd, "ERR cannot load %s", tok[1]);
+      return;
+    }
+    j.addr = (ntok == 3) ? strtoul(tok[2], NULL, 0) : j.img->target;
+    j.len = j.img->padded;
+    if ((j.img->jedec[0] | j.img->jedec[1] | j.img->jedec[2]) && memcmp(j.img->jedec, _chip->jedec, 3) != 0) {
+      sendLine(c->fd, "ERR package is made for JEDEC ID %02X %02X %02X", j.img->jedec[0], j.img->jedec[1], j.img->jedec[2]);
+      return;
+    }
+    if (j.addr % SECTOR_SIZE) {
+      sendLine(c->fd, "ERR address must be sector aligned");
+      return;
+    }
+  } else if (strcmp(tok[0], "READ") == 0 && ntok == 4) {
+    j.type = JOB_READ;
+    j.addr = strtoul(tok[1], NULL, 0);
+    j.len = strtoul(tok[2], NULL, 0);
+    j.out = fopen(tok[3], "wb");
+    if (j.out == NULL) {
+      sendLine(c->fd, "ERR cannot open %s", tok[3]);
+      return;
+    }
+  } else {
+    sendLine(c->fd, "ERR bad request");
+    return;
+  }
+
+  if ((uint64_t)j.addr + j.len > _chip->size) {
+    sendLine(c->fd, "ERR range exceeds flash size");
+    if (j.out) fclose(j.out);
+    return;
+  }
+  if (_kv && j.type != JOB_READ && j.type != JOB_VERIFY && (uint64_t)j.addr + j.len > _chip->size - KV_SIZE) {
+    sendLine(c->fd, "ERR range overlaps the key-value store at %08x", _chip->size - KV_SIZE);
+    return;
+  }
+  for (i = 0; i < MAX_JOBS && _jobs[i].used; i++) ;
+  if (i == MAX_JOBS) {
+    sendLine(c->fd, "ERR queue is full");
+    if (j.out) fclose(j.out);
+    return;
+  }
+  if (j.img) j.img->refs++;        // jobFinish() 에서 놓는다
+  j.used = true;
+  j.id = _next_id++;
+  j.seq = _seq++;
+  _jobs[i] = j;
+  sendLine(c->fd, "QUEUED %u", j.id);
+}
+
+//
+// 다음 job 선택 (prio 가 높은 것, 같으면 먼저 들어온 것)
+//
+static struct job* nextJob(void) {
+  struct job* best = NULL;
+  uint16_t i;
+  for (i = 0; i < MAX_JOBS; i++) {
+    struct job* q = &_jobs[i];
+    if (!q->used) continue;
+    if (best == NULL || q->prio > best->prio || (q->prio == best->prio && q->seq < best->seq)) best = q;
+  }
+  return best;
+}
+
+//
+// 지우기/쓰기 실패 기록 (job 은 거기서 멈춘다)
+//
+static void jobFail(struct job* j, const char* what, uint32_t addr) {
+  j->fail = what;
+  j->fail_addr = addr;
+}
+
+//
+// PROGRAM 1 step: 64KB block 안의 변경된 섹터만 지우고 쓰고 검증
+// 반환값: false: 지우기/쓰기 실패 또는 검증 실패
+//
+static bool stepProgram(struct job* j, uint32_t addr, uint32_t n) {
+  const uint8_t* src = &j->img->data[j->pos];
+  uint16_t psize = _chip->page_size;
+  bool changed[STEP_SIZE / SECTOR_SIZE];
+  uint32_t s, nsect = n / SECTOR_SIZE, nchanged = 0;
+
+  IS25LP256_fastread(addr, _buf, n);
+  for (s = 0; s < nsect; s++) {
+    changed[s] = memcmp(&_buf[s * SECTOR_SIZE], &src[s * SECTOR_SIZE], SECTOR_SIZE) != 0;
+    if (changed[s]) nchanged++;
+  }
+  if (nchanged == 0) return true;
+
+  if (n == STEP_SIZE && addr % STEP_SIZE == 0 && nchanged == nsect) {
+    if (!IS25LP256_erase64Block(addr / STEP_SIZE, true)) {
+      jobFail(j, "erase", addr);
+      return false;
+    }
+  } else {
+    for (s = 0; s < nsect; s++) {
+      if (changed[s] && !IS25LP256_eraseSector((addr + s * SECTOR_SIZE) / SECTOR_SIZE, true)) {
+        jobFail(j, "erase", addr + s * SECTOR_SIZE);
+        return false;
+      }
+    }
+  }
+  for (s = 0; s < nsect; s++) {
+    uint32_t p;
+    if (!changed[s]) continue;
+    for (p = 0; p < SECTOR_SIZE; p += psize) {
+      const uint8_t* pg = &src[s * SECTOR_SIZE + p];
+      uint32_t k;
+      for (k = 0; k < psize && pg[k] == 0xFF; k++) ;
+      if (k == psize) continue;               // blank page
+      if (IS25LP256_write(addr + s * SECTOR_SIZE + p, pg, psize) != psize) {
+        jobFail(j, "program", addr + s * SECTOR_SIZE + p);
+        return false;
+      }
+    }
+    IS25LP256_fastread(addr + s * SECTOR_SIZE, &_buf[s * SECTOR_SIZE], SECTOR_SIZE);
+    if (memcmp(&_buf[s * SECTOR_SIZE], &src[s * SECTOR_SIZE], SECTOR_SIZE) != 0) j->bad++;
+  }
+  return j->bad == 0;
+}
+
+//
+// job 1 step 실행
+// 반환값: true: job 종료
+//
+static bool jobStep(struct job* j) {
+  uint32_t addr = j->addr + j->pos;
+  uint32_t n = STEP_SIZE - (addr % STEP_SIZE);    // 64KB block 경계까지
+  uint32_t s;
+
+  if (n > j->len - j->pos) n = j->len - j->pos;
+  if (n == 0) return true;
+
+  if (j->pos == 0 && (j->type == JOB_ERASE || j->type == JOB_PROGRAM)) {
+    // 도중에 끊겨도 scrubber 가 예전 baseline 으로 검사/복구하지 않도록 먼저 빼 둔다
+    SCRUB_invalidate(j->addr, j->len);
+    SCRUB_save(SCRUB_BASELINE);
+  }
+
+  switch (j->type) {
+  case JOB_ERASE:
+    if (n == STEP_SIZE) {
+      if (!IS25LP256_erase64Block(addr / STEP_SIZE, true)) jobFail(j, "erase", addr);
+    } else {
+      for (s = 0; s < n && j->fail == NULL; s += SECTOR_SIZE) {
+        if (!IS25LP256_eraseSector((addr + s) / SECTOR_SIZE, true)) jobFail(j, "erase", addr + s);
+      }
+    }
+    if (j->fail) return true;   // stop at first failed erase
+    SCRUB_adopt(addr, n);
+    break;
+  case JOB_PROGRAM:
+    if (!stepProgram(j, addr, n)) {
+      j->pos += n;
+      return true;          // stop at first failed block
+    }
+    SCRUB_set(addr, &j->img->data[j->pos], n);
+    break;
+  case JOB_VERIFY:
+    IS25LP256_fastread(addr, _buf, n);
+    for (s = 0; s < n; s += SECTOR_SIZE) {
+      if (memcmp(&_buf[s], &j->img->data[j->pos + s], SECTOR_SIZE) != 0) j->bad++;
+    }
+    break;
+  case JOB_READ:
+    IS25LP256_fastread(addr, _buf, n);
+    if (fwrite(_buf, 1, n, j->out) != n) j->bad++;
+    break;
+  }
+  j->pos += n;
+  return j->pos >= j->len || (j->type == JOB_READ && j->bad);
+}
+
+static void jobFinish(struct job* j) {
+  bool ok = (j->bad == 0 && j->fail == NULL && j->pos >= j->len);
+
+  if (j->out) fclose(j->out);
+  if (j->img) j->img->refs--;
+  if (ok && j->type == JOB_PROGRAM && j->reconfig) _reconfig_pending = true;
+  if (j->type == JOB_ERASE || j->type == JOB_PROGRAM) SCRUB_save(SCRUB_BASELINE);
+  if (j->fail) {
+    sendLine(j->client, "DONE %u FAIL %s %s failed at %08x", j->id, _job_name[j->type], j->fail, j->fail_addr);
+  } else {
+    sendLine(j->client, "DONE %u %s %s %u bytes, %u bad sectors", j->id, ok ? "OK" : "FAIL",
+             _job_name[j->type], j->pos, j->bad);
+  }
+  printf("Job %u %s %s\n", j->id, _job_name[j->type], ok ? "OK" : "FAIL");
+  memset(j, 0, sizeof(*j));
+}
+
+static void closeClient(struct client* c) {
+  uint16_t i;
+  for (i = 0; i < MAX_JOBS; i++) {
+    if (_jobs[i].used && _jobs[i].client == c->fd) _jobs[i].client = -1;   // job keeps running
+  }
+  close(c->fd);
+  c->fd = -1;
+  c->nout = 0;
+}
+
+//
+// Main program
+//    flashd [socket path]
+//
+int main(int argc, char* argv[]) {
+  const char* path = (argc > 1) ? argv[1] : FLASHD_SOCKET;
+  struct pollfd pfd[MAX_CLIENTS + 1];
+  struct sockaddr_un sa;
+  struct sigaction act;
+  int lfd;
+  uint16_t i;
+
+  if (!BOARD_open(GPIO_CHIP)) return 1;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    BOARD_close();
+    return 1;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+
+  BOARD_bypassEnable();
+  _chip = IS25LP256_detect();
+  if (_chip && KV_probe(_chip->size - KV_SIZE, KV_SIZE)) _kv = KV_open(_chip->size - KV_SIZE, KV_SIZE);
+  BOARD_bypassDisable();
+  if (_chip == NULL) {
+    printf("Unknown flash chip\n");
+    IS25LP256_end();
+    BOARD_close();
+    return 1;
+  }
+  printf("Flash chip: %s, %u bytes\n", _chip->name, _chip->size);
+  if (_kv) printf("Key-value store: %u keys at %08x, collected when idle\n", KV_count(), _chip->size - KV_SIZE);
+  // key-value store 는 계속 바뀌므로 scrub 하지 않는다
+  SCRUB_load(SCRUB_BASELINE, _chip->size);
+  if (_kv && SCRUB_invalidate(_chip->size - KV_SIZE, KV_SIZE)) SCRUB_save(SCRUB_BASELINE);
+
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = onSignal;
+  sigaction(SIGINT, &act, NULL);
+  sigaction(SIGTERM, &act, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+  unlink(path);
+  if (lfd < 0 || bind(lfd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(lfd, 4) < 0) {
+    perror("flashd socket");
+    IS25LP256_end();
+    BOARD_close();
+    return 1;
+  }
+  printf("Listening on %s\n", path);
+  for (i = 0; i < MAX_CLIENTS; i++) _clients[i].fd = -1;
+
+  while (!_stop) {
+    int n = 0, timeout, pr;
+
+    pfd[n].fd = lfd;
+    pfd[n++].events = POLLIN;
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      pfd[n].fd = _clients[i].fd;         // -1 is ignored by poll
+      pfd[n++].events = POLLIN | (_clients[i].nout ? POLLOUT : 0);
+    }
+    // job 이 있으면 기다리지 않고 확인만 한다. 수집할 KV 섹터가 있으면 KV_GC_IDLE_MS 동안 요청이 없을 때 1개 수집
+    if (_cur || nextJob()) timeout = 0;
+    else timeout = (_kv && KV_gcPending()) ? KV_GC_IDLE_MS : -1;
+    pr = poll(pfd, n, timeout);
+    if (pr < 0 && errno != EINTR) break;
+    if (pr == 0 && timeout > 0) {
+      BOARD_bypassEnable();
+      KV_gcStep();
+      printf("Key-value store: one sector collected, FPGA offline %u ms\n", BOARD_bypassDisable());
+      continue;
+    }
+
+    if (pfd[0].revents & POLLIN) {
+      int fd = accept(lfd, NULL, NULL);
+      for (i = 0; fd >= 0 && i < MAX_CLIENTS && _clients[i].fd >= 0; i++) ;
+      if (fd >= 0 && i == MAX_CLIENTS) close(fd);
+      else if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        _clients[i].fd = fd;
+        _clients[i].n = 0;
+        _clients[i].nout = 0;
+      }
+    }
+    for (i = 0; i < MAX_CLIENTS; i++) {
+      struct client* c = &_clients[i];
+      char* nl;
+      ssize_t r;
+      if (c->fd >= 0 && (pfd[i + 1].revents & POLLOUT)) flushClient(c);
+      if (c->fd < 0 || !(pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      r = read(c->fd, &c->line[c->n], sizeof(c->line) - 1 - c->n);
+      if (r < 0 && errno == EAGAIN) continue;
+      if (r <= 0) {
+        closeClient(c);
+        continue;
+      }
+      c->n += r;
+      c->line[c->n] = 0;
+      while ((nl = strchr(c->line, '\n')) != NULL) {
+        *nl = 0;
+        handleLine(c, c->line);
+        if (c->fd < 0) break;                     // disconnected by sendLine
+        c->n -= (nl + 1 - c->line);
+        memmove(c->line, nl + 1, c->n + 1);
+      }
+      if (c->n == sizeof(c->line) - 1) c->n = 0;    // too long line, drop
+    }
+
+    // job 실행 (1 step)
+    if (_cur == NULL) {
+      _cur = nextJob();
+      if (_cur) BOARD_bypassEnable();
+    }
+    if (_cur) {
+      bool done = jobStep(_cur);
+      sendLine(_cur->client, "PROGRESS %u %u %u", _cur->id, _cur->pos, _cur->len);
+      if (done) {
+        jobFinish(_cur);
+        _cur = NULL;
+        if (nextJob() == NULL) {
+          uint32_t ms = BOARD_bypassDisable();
+          printf("Queue empty, FPGA offline %u ms\n", ms);
+          if (_reconfig_pending) {
+            if (!BOARD_canReconfigure()) printf("FPGA reconfiguration skipped (no valid %s)\n", BOARD_RECONFIG_ENV);
+            else printf("FPGA reconfiguration %s\n", BOARD_reconfigure(BOARD_RECONFIG_TIMEOUT_MS) ? "started" : "failed");
+            _reconfig_pending = false;
+          }
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < MAX_CLIENTS; i++) {
+    if (_clients[i].fd >= 0) close(_clients[i].fd);
+  }
+  for (i = 0; i < MAX_JOBS; i++) {
+    if (_jobs[i].out) fclose(_jobs[i].out);
+  }
+  for (i = 0; i < IMAGE_CACHE; i++) free(_images[i].data);
+  if (_kv) KV_close();
+  close(lfd);
+  unlink(path);
+  IS25LP256_end();
+  BOARD_close();
+  return 0;
+}
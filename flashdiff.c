@@ -0,0 +1,269 @@
+//
+// Compare SPI Flash with an image file and show only the differences
+//
+//    sudo ./flashdiff [-o offset] [-a addr] [-l len] [-m max_ranges] [-g gap] image.bin
+//    ex) sudo ./flashdiff SMI_v2.2_240613_1xSPI.bin
+//        sudo ./flashdiff -a 0x380000 -l 0x10000 SMI_v2.2_240613_1xSPI.bin
+//
+// Image is at offset (default 0). Range is addr/len (default: whole image), flash outside
+// the image is compared with 0xFF (erased). Flash is read by 64KB fast reads in one bypass window.
+// Equal sectors are skipped by memcmp (vectorized in libc), differing bytes are located 8 bytes at a time.
+// Differing bytes closer than gap (default 16) in one 64KB block are merged into one range.
+// Exit code 2: flash differs
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "util.h"
+
+#define SECTOR_SIZE  4096
+#define BLOCK_SIZE   65536
+#define ROW          16
+
+static uint8_t _flash[BLOCK_SIZE];
+static uint8_t _want[BLOCK_SIZE];
+static uint8_t* _image;
+static uint32_t _image_size, _offset;
+
+// Range being collected
+static bool _in_range;
+static uint32_t _r_start, _r_end, _r_diff;         // [start, end], differing bytes
+static uint32_t _max_ranges = 64, _nranges, _gap = 16;
+
+// Counters
+static uint32_t _diff_bytes, _diff_sectors, _diff_blocks;
+static uint32_t _blk_diff, _blk_sectors;           // of the current 64KB block
+
+static uint8_t* _range_flash;                       // copy of flash/image bytes of the current range
+static uint8_t* _range_want;
+static uint32_t _range_cap;
+
+//
+// 기대값 채우기 (이미지 밖은 0xFF)
+//
+static void expected(uint32_t addr, uint8_t* out, uint32_t n) {
+  uint32_t i = 0, off, cnt;
+
+  if (addr < _offset) {
+    i = (_offset - addr < n) ? _offset - addr : n;
+    memset(out, 0xFF, i);
+  }
+  if (i < n && addr + i - _offset < _image_size) {
+    off = addr + i - _offset;
+    cnt = (_image_size - off < n - i) ? _image_size - off : n - i;
+    memcpy(&out[i], &_image[off], cnt);
+    i += cnt;
+  }
+  memset(&out[i], 0xFF, n - i);
+}
+
+//
+// 한 범위 출력 (다른 바이트가 있는 16 byte 행만, 이미지 행은 같은 바이트를 .. 로)
+//
+static void printRange(void) {
+  uint32_t row, k, a;
+
+  _nranges++;
+  if (_nranges > _max_ranges) return;
+  printf("%08x-%08x  sector %u, block %u: %u bytes differ\n", _r_start, _r_end,
+         _r_start / SECTOR_SIZE, _r_start / BLOCK_SIZE, _r_diff);
+  for (row = _r_start & ~(ROW - 1); row <= _r_end; row += ROW) {
+    bool any = false;
+    for (k = 0; k < ROW; k++) {
+      a = row + k;
+      if (a >= _r_start && a <= _r_end && _range_flash[a - _r_start] != _range_want[a - _r_start]) any = true;
+    }
+    if (!any) continue;
+    printf("  %08x flash:", row);
+    for (k = 0; k < ROW; k++) {
+      a = row + k;
+      if (a > _r_end) break;
+      if (a < _r_start) printf("   ");
+      else printf(" %02x", _range_flash[a - _r_start]);
+    }
+    printf("\n           image:");
+    for (k = 0; k < ROW; k++) {
+      a = row + k;
+      if (a > _r_end) break;
+      if (a < _r_start) printf("   ");
+      else if (_range_flash[a - _r_start] == _range_want[a - _r_start]) printf(" ..");
+      else printf(" %02x", _range_want[a - _r_start]);
+    }
+    printf("\n");
+  }
+}
+
+//
+// 다른 바이트 하나를 범위에 추가 (gap 보다 가까우면 이어 붙임)
+//
+static void addDiff(uint32_t addr, const uint8_t* flash, const uint8_t* want, uint32_t base) {
+  uint32_t a, need;
+
+  if (_in_range && addr - _r_end > _gap) {
+    printRange();
+    _in_range = false;
+  }
+  if (!_in_range) {
+    _in_range = true;
+    _r_start = _r_end = addr;
+    _r_diff = 0;
+  }
+  need = addr - _r_start + 1;
+  if (need > _range_cap) {
+    _range_cap = need * 2;
+    _range_flash = (uint8_t*)realloc(_range_flash, _range_cap);
+    _range_want = (uint8_t*)realloc(_range_want, _range_cap);
+    if (_range_flash == NULL || _range_want == NULL) {
+      printf("Out of memory\n");
+      exit(1);
+    }
+  }
+  // 범위 안의 같은 바이트도 출력용으로 복사 (buffer 는 base 부터)
+  for (a = _r_end + (_r_diff ? 1 : 0); a <= addr; a++) {
+    _range_flash[a - _r_start] = flash[a - base];
+    _range_want[a - _r_start] = want[a - base];
+  }
+  _r_end = addr;
+  _r_diff++;
+}
+
+//
+// 64KB 이하 구간 비교
+// 같은 섹터는 memcmp 로 건너뛰고, 다른 섹터만 8 byte 씩 XOR 해서 다른 바이트를 찾는다
+//
+static void compareChunk(uint32_t addr, uint32_t n) {
+  uint32_t s, off, end;
+
+  for (s = 0; s < n; s = end) {
+    end = (addr + s) / SECTOR_SIZE * SECTOR_SIZE + SECTOR_SIZE - addr;   // 다음 섹터 경계
+    if (end > n) end = n;
+    if (memcmp(&_flash[s], &_want[s], end - s) == 0) continue;
+
+    uint32_t before = _diff_bytes;
+    for (off = s; off < end; ) {
+      uint64_t x, y;
+      if (end - off >= 8) {
+        memcpy(&x, &_flash[off], 8);
+        memcpy(&y, &_want[off], 8);
+        x ^= y;
+        if (x == 0) {
+          off += 8;
+          continue;
+        }
+        off += __builtin_ctzll(x) / 8;      // little endian: 처음 다른 바이트
+      } else if (_flash[off] == _want[off]) {
+        off++;
+        continue;
+      }
+      addDiff(addr + off, _flash, _want, addr);
+      _diff_bytes++;
+      off++;
+    }
+    _blk_diff += _diff_bytes - before;
+    _blk_sectors++;
+    _diff_sectors++;
+  }
+}
+
+static void blockSummary(uint32_t blk) {
+  if (_blk_diff == 0) return;
+  _diff_blocks++;
+  if (_nranges <= _max_ranges) printf("Block %u (%08x): %u sectors, %u bytes differ\n",
+                                      blk, blk * BLOCK_SIZE, _blk_sectors, _blk_diff);
+  _blk_diff = _blk_sectors = 0;
+}
+
+static void usage(void) {
+  printf("usage: flashdiff [-o offset] [-a addr] [-l len] [-m max_ranges] [-g gap] image.bin\n");
+}
+
+//
+// Main program
+//
+int main(int argc, char* argv[]) {
+  uint32_t addr = 0, len = 0, a, n, us, ms, blk;
+  bool have_addr = false;
+  const struct flash_profile* chip;
+  struct timespec t0;
+  int opt, rc = 1;
+
+  while ((opt = getopt(argc, argv, "o:a:l:m:g:")) != -1) {
+    switch (opt) {
+    case 'o': _offset = strtoul(optarg, NULL, 0); break;
+    case 'a': addr = strtoul(optarg, NULL, 0); have_addr = true; break;
+    case 'l': len = strtoul(optarg, NULL, 0); break;
+    case 'm': _max_ranges = strtoul(optarg, NULL, 0); break;
+    case 'g': _gap = strtoul(optarg, NULL, 0); break;
+    default: usage(); return 1;
+    }
+  }
+  if (argc - optind != 1) {
+    usage();
+    return 1;
+  }
+  if ((_image = UTIL_readFile(argv[optind], &_image_size)) == NULL) return 1;
+  if (!have_addr) addr = _offset;
+  if (len == 0 && addr < _offset + _image_size) len = _offset + _image_size - addr;
+  if (len == 0) {
+    usage();
+    goto end_file;
+  }
+
+  if (!BOARD_open(GPIO_CHIP)) goto end_file;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    goto end_board;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+
+  BOARD_bypassEnable();
+  chip = IS25LP256_detect();
+  if (chip == NULL) {
+    printf("Unknown flash chip\n");
+    goto end_bypass;
+  }
+  if ((uint64_t)addr + len > chip->size) {
+    printf("Range %08x + %u is out of flash (%u bytes)\n", addr, len, chip->size);
+    goto end_bypass;
+  }
+  printf("Compare %08x-%08x with %s at %08x\n", addr, addr + len - 1, argv[optind], _offset);
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  blk = addr / BLOCK_SIZE;
+  for (a = addr; a < addr + len; a += n) {
+    n = BLOCK_SIZE - a % BLOCK_SIZE;        // 64KB block 단위로 읽는다 (block 별 집계)
+    if (n > addr + len - a) n = addr + len - a;
+    IS25LP256_fastread(a, _flash, n);
+    expected(a, _want, n);
+    compareChunk(a, n);
+    // 범위는 block 을 넘지 않는다
+    if (_in_range) printRange();
+    _in_range = false;
+    blockSummary(blk++);
+  }
+  us = UTIL_elapsedUs(&t0);
+  rc = (_diff_bytes == 0) ? 0 : 2;
+
+  if (_nranges > _max_ranges) printf("... %u more ranges not shown (-m)\n", _nranges - _max_ranges);
+  printf("%u bytes differ in %u ranges, %u sectors, %u blocks\n", _diff_bytes, _nranges, _diff_sectors, _diff_blocks);
+  printf("Read and compared %u bytes in %u ms (%.2f MB/s)\n", len, us / 1000, us ? (double)len / us : 0.0);
+
+end_bypass:
+  ms = BOARD_bypassDisable();
+  printf("FPGA offline %u ms\n", ms);
+  IS25LP256_end();
+end_board:
+  BOARD_close();
+end_file:
+  free(_image);
+  free(_range_flash);
+  free(_range_want);
+  return rc;
+}
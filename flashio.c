@@ -0,0 +1,328 @@
+//
+// Byte addressable access to SPI Flash with a small write-back sector cache
+//
+// Several small writes to the same sector are merged in cache, and one sector
+// is written back with at most one erase:
+//   - if only 1->0 bit changes are needed, the sector is not erased and only changed pages are programmed
+//   - otherwise the sector is erased once and only pages which are not all 0xFF are programmed
+//   - if all 16 sectors of a 64KB block are dirty in cache, one 64KB block erase is used
+// Reads go through a read cache of 64KB blocks, so bulk reads use long fast read transfers.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IS25LP256.h"
+#include "flashio.h"
+
+#define SECTORS_PER_BLOCK (FLASHIO_BLOCK_SIZE / FLASHIO_SECTOR_SIZE)
+
+struct cache_sector {
+  bool     valid;
+  bool     dirty;
+  uint16_t sect_no;
+  uint32_t lru;                           // last access tick
+  uint8_t  data[FLASHIO_SECTOR_SIZE];     // current (merged) data
+  uint8_t  orig[FLASHIO_SECTOR_SIZE];     // data in flash
+};
+
+struct cache_block {
+  bool     valid;
+  uint16_t blk_no;
+  uint32_t lru;
+  uint8_t  data[FLASHIO_BLOCK_SIZE];
+};
+
+static struct cache_sector* _cache;     // FLASHIO_CACHE_SECTORS, FLASHIO_open() 에서 할당
+static struct cache_block* _rcache;     // FLASHIO_RCACHE_BLOCKS, always holds latest data (including dirty sectors)
+static uint32_t _tick;
+static uint32_t _erases, _noerase, _pages;
+
+//
+// read cache 에서 block 찾기
+//
+static struct cache_block* findBlock(uint16_t blk_no) {
+  uint16_t i;
+  for (i = 0; i < FLASHIO_RCACHE_BLOCKS; i++) {
+    if (_rcache[i].valid && _rcache[i].blk_no == blk_no) return &_rcache[i];
+  }
+  return NULL;
+}
+
+//
+// read cache 로 block 가져오기 (없으면 LRU block 에 64KB 를 한번에 읽음)
+//
+static struct cache_block* getBlock(uint16_t blk_no) {
+  struct cache_block* b = findBlock(blk_no);
+  uint16_t i;
+
+  _tick++;
+  if (b == NULL) {
+    b = &_rcache[0];
+    for (i = 0; i < FLASHIO_RCACHE_BLOCKS; i++) {
+      if (!_rcache[i].valid) { b = &_rcache[i]; break; }
+      if (_rcache[i].lru < b->lru) b = &_rcache[i];
+    }
+    if (IS25LP256_fastread((uint32_t)blk_no * FLASHIO_BLOCK_SIZE, b->data, FLASHIO_BLOCK_SIZE) != FLASHIO_BLOCK_SIZE) {
+      b->valid = false;
+      return NULL;
+    }
+    b->valid = true;
+    b->blk_no = blk_no;
+
+    // 아직 기록되지 않은 cache 섹터 내용을 덮어써서 최신 상태로 유지
+    for (i = 0; i < FLASHIO_CACHE_SECTORS; i++) {
+      if (_cache[i].valid && _cache[i].sect_no / SECTORS_PER_BLOCK == blk_no) {
+        memcpy(&b->data[(_cache[i].sect_no % SECTORS_PER_BLOCK) * FLASHIO_SECTOR_SIZE], _cache[i].data, FLASHIO_SECTOR_SIZE);
+      }
+    }
+  }
+  b->lru = _tick;
+  return b;
+}
+
+//
+// read cache 내용 갱신 (cache 에 있는 block 만)
+// buf 가 NULL 이면 0xFF (지워진 상태)
+//
+static void updateBlock(uint32_t addr, const uint8_t* buf, uint32_t len) {
+  while (len > 0) {
+    uint32_t off = addr % FLASHIO_BLOCK_SIZE;
+    uint32_t n = FLASHIO_BLOCK_SIZE - off;
+    struct cache_block* b = findBlock(addr / FLASHIO_BLOCK_SIZE);
+    if (n > len) n = len;
+    if (b != NULL) {
+      if (buf) memcpy(&b->data[off], buf, n);
+      else memset(&b->data[off], 0xFF, n);
+    }
+    addr += n;
+    if (buf) buf += n;
+    len -= n;
+  }
+}
+
+static struct cache_sector* findSector(uint16_t sect_no) {
+  uint16_t i;
+  for (i = 0; i < FLASHIO_CACHE_SECTORS; i++) {
+    if (_cache[i].valid && _cache[i].sect_no == sect_no) return &_cache[i];
+  }
+  return NULL;
+}
+
+//
+// 1->0 변화만 있으면 지우지 않아도 된다
+//
+static bool needErase(const struct cache_sector* c) {
+  uint32_t i;
+  for (i = 0; i < FLASHIO_SECTOR_SIZE; i++) {
+    if ((c->orig[i] & c->data[i]) != c->data[i]) return true;
+  }
+  return false;
+}
+
+//
+// 바뀐 page 만 program
+//
+static bool programSector(struct cache_sector* c) {
+  const struct flash_profile* chip = IS25LP256_profile();
+  uint32_t base = (uint32_t)c->sect_no * FLASHIO_SECTOR_SIZE;
+  uint32_t p;
+
+  for (p = 0; p < FLASHIO_SECTOR_SIZE; p += chip->page_size) {
+    if (memcmp(&c->data[p], &c->orig[p], chip->page_size) == 0) continue;
+    if (IS25LP256_write(base + p, &c->data[p], chip->page_size) != chip->page_size) {
+      printf("FLASHIO: program failed at %08x\n", base + p);
+      return false;
+    }
+    _pages++;
+  }
+
+  memcpy(c->orig, c->data, FLASHIO_SECTOR_SIZE);
+  c->dirty = false;
+  return true;
+}
+
+//
+// 섹터를 flash 에 기록
+// 같은 64KB block 의 16개 섹터가 모두 dirty 로 cache 에 있으면 block 단위로 한번에 지운다.
+// 반환값: true:정상 종료 false:실패
+//
+static bool writeBack(struct cache_sector* c) {
+  struct cache_sector* blk[SECTORS_PER_BLOCK];
+  uint16_t first = c->sect_no - (c->sect_no % SECTORS_PER_BLOCK);
+  bool ok = true;
+  uint16_t i;
+
+  if (!c->dirty) return true;
+  if (!needErase(c)) {
+    _noerase++;
+    return programSector(c);
+  }
+
+  for (i = 0; i < SECTORS_PER_BLOCK; i++) {
+    blk[i] = findSector(first + i);
+    if (blk[i] == NULL || !blk[i]->dirty) break;
+  }
+  if (i == SECTORS_PER_BLOCK) {
+    IS25LP256_erase64Block(first / SECTORS_PER_BLOCK, true);
+    _erases++;
+    for (i = 0; i < SECTORS_PER_BLOCK; i++) {
+      memset(blk[i]->orig, 0xFF, FLASHIO_SECTOR_SIZE);
+      if (!programSector(blk[i])) ok = false;
+    }
+    return ok;
+  }
+
+  IS25LP256_eraseSector(c->sect_no, true);
+  memset(c->orig, 0xFF, FLASHIO_SECTOR_SIZE);
+  _erases++;
+  return programSector(c);
+}
+
+//
+// 섹터를 cache 로 가져오기 (없으면 LRU 섹터를 내보내고 flash 에서 읽음)
+//
+static struct cache_sector* getSector(uint16_t sect_no) {
+  struct cache_sector* victim = &_cache[0];
+  struct cache_block* b;
+  uint16_t i;
+
+  _tick++;
+  for (i = 0; i < FLASHIO_CACHE_SECTORS; i++) {
+    if (_cache[i].valid && _cache[i].sect_no == sect_no) {
+      _cache[i].lru = _tick;
+      return &_cache[i];
+    }
+    if (!_cache[i].valid) victim = &_cache[i];
+    else if (victim->valid && _cache[i].lru < victim->lru) victim = &_cache[i];
+  }
+
+  if (victim->valid && !writeBack(victim)) return NULL;
+
+  b = getBlock(sect_no / SECTORS_PER_BLOCK);
+  if (b == NULL) return NULL;
+  memcpy(victim->orig, &b->data[(sect_no % SECTORS_PER_BLOCK) * FLASHIO_SECTOR_SIZE], FLASHIO_SECTOR_SIZE);
+  memcpy(victim->data, victim->orig, FLASHIO_SECTOR_SIZE);
+  victim->valid = true;
+  victim->dirty = false;
+  victim->sect_no = sect_no;
+  victim->lru = _tick;
+  return victim;
+}
+
+bool FLASHIO_open(void) {
+  if (_cache == NULL) _cache = (struct cache_sector*)malloc(sizeof(struct cache_sector) * FLASHIO_CACHE_SECTORS);
+  if (_rcache == NULL) _rcache = (struct cache_block*)malloc(sizeof(struct cache_block) * FLASHIO_RCACHE_BLOCKS);
+  if (_cache == NULL || _rcache == NULL) {
+    printf("FLASHIO_open: out of memory\n");
+    FLASHIO_close();
+    return false;
+  }
+  FLASHIO_invalidate();
+  return true;
+}
+
+void FLASHIO_close(void) {
+  free(_cache);
+  free(_rcache);
+  _cache = NULL;
+  _rcache = NULL;
+}
+
+bool FLASHIO_write(uint32_t addr, const uint8_t* buf, uint32_t len) {
+  if (_cache == NULL) return false;
+  while (len > 0) {
+    uint32_t off = addr % FLASHIO_SECTOR_SIZE;
+    uint32_t n = FLASHIO_SECTOR_SIZE - off;
+    if (n > len) n = len;
+
+    struct cache_sector* c = getSector(addr / FLASHIO_SECTOR_SIZE);
+    if (c == NULL) return false;
+    if (memcmp(&c->data[off], buf, n) != 0) {
+      memcpy(&c->data[off], buf, n);
+      c->dirty = true;
+      updateBlock(addr, buf, n);
+    }
+    addr += n;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool FLASHIO_read(uint32_t addr, uint8_t* buf, uint32_t len) {
+  if (_cache == NULL) return false;
+  while (len > 0) {
+    uint32_t off = addr % FLASHIO_SECTOR_SIZE;
+    uint32_t n = FLASHIO_SECTOR_SIZE - off;
+    struct cache_sector* c;
+    struct cache_block* b;
+    if (n > len) n = len;
+
+    c = findSector(addr / FLASHIO_SECTOR_SIZE);
+    if (c != NULL) {
+      memcpy(buf, &c->data[off], n);
+    } else {
+      b = getBlock(addr / FLASHIO_BLOCK_SIZE);
+      if (b == NULL) return false;
+      memcpy(buf, &b->data[addr % FLASHIO_BLOCK_SIZE], n);
+    }
+    addr += n;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool FLASHIO_erase(uint32_t addr, uint32_t len) {
+  struct cache_sector* c;
+  uint32_t end;
+
+  if (_cache == NULL || addr % FLASHIO_SECTOR_SIZE || len % FLASHIO_SECTOR_SIZE) return false;
+  end = addr + len;
+
+  // 지울 영역의 cache 섹터는 버린다
+  for (; addr < end; ) {
+    if (addr % FLASHIO_BLOCK_SIZE == 0 && end - addr >= FLASHIO_BLOCK_SIZE) {
+      IS25LP256_erase64Block(addr / FLASHIO_BLOCK_SIZE, true);
+      len = FLASHIO_BLOCK_SIZE;
+    } else {
+      IS25LP256_eraseSector(addr / FLASHIO_SECTOR_SIZE, true);
+      len = FLASHIO_SECTOR_SIZE;
+    }
+    _erases++;
+    updateBlock(addr, NULL, len);
+    for (uint32_t a = addr; a < addr + len; a += FLASHIO_SECTOR_SIZE) {
+      c = findSector(a / FLASHIO_SECTOR_SIZE);
+      if (c != NULL) c->valid = false;
+    }
+    addr += len;
+  }
+  return true;
+}
+
+bool FLASHIO_flush(void) {
+  bool ok = true;
+  uint16_t i;
+
+  if (_cache == NULL) return true;
+  for (i = 0; i < FLASHIO_CACHE_SECTORS; i++) {
+    if (_cache[i].valid && !writeBack(&_cache[i])) ok = false;
+  }
+  return ok;
+}
+
+void FLASHIO_invalidate(void) {
+  uint16_t i;
+  if (_cache == NULL) return;
+  for (i = 0; i < FLASHIO_CACHE_SECTORS; i++) _cache[i].valid = false;
+  for (i = 0; i < FLASHIO_RCACHE_BLOCKS; i++) _rcache[i].valid = false;
+}
+
+void FLASHIO_stats(uint32_t* erases, uint32_t* noerase, uint32_t* pages) {
+  *erases = _erases;
+  *noerase = _noerase;
+  *pages = _pages;
+}
@@ -0,0 +1,36 @@
+//
+// Byte addressable access to SPI Flash with a small write-back sector cache
+// Page split, erase-before-write and read-modify-write of 4KB sectors are handled here.
+//
+
+#define FLASHIO_SECTOR_SIZE   4096    // erase unit
+#define FLASHIO_BLOCK_SIZE    65536   // 64KB block erase unit
+#define FLASHIO_CACHE_SECTORS 32      // number of sectors kept in write-back cache (2 blocks)
+#define FLASHIO_RCACHE_BLOCKS 16      // number of 64KB blocks kept in read cache
+
+// Allocate the caches (about 1.3MB, only tools which use this layer pay for it) and invalidate them
+// Return: true:success false:out of memory
+bool FLASHIO_open(void);
+
+// Free the caches. Dirty sectors are dropped, call FLASHIO_flush() first.
+void FLASHIO_close(void);
+
+// Write data to any address. Data is merged in cache and written by FLASHIO_flush()
+// or when the sector is evicted. Return: true:success false:failure
+bool FLASHIO_write(uint32_t addr, const uint8_t* buf, uint32_t len);
+
+// Read data from any address (cached data is returned for cached sectors)
+bool FLASHIO_read(uint32_t addr, uint8_t* buf, uint32_t len);
+
+// Erase sector aligned range (addr, len: multiple of FLASHIO_SECTOR_SIZE)
+// 64KB blocks are used where the range covers a whole block. Return: true:success false:failure
+bool FLASHIO_erase(uint32_t addr, uint32_t len);
+
+// Write all dirty sectors to flash. Return: true:success false:failure
+bool FLASHIO_flush(void);
+
+// Drop all cached sectors without writing (after flash is changed by other functions)
+void FLASHIO_invalidate(void);
+
+// Statistics of write-back (erases, sectors written without erase, pages programmed)
+void FLASHIO_stats(uint32_t* erases, uint32_t* noerase, uint32_t* pages);
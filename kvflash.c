@@ -0,0 +1,120 @@
+//
+// Key-value parameters in the unused area of SPI Flash (kvstore.c)
+//
+//    sudo ./kvflash set serial SMI-000123
+//    sudo ./kvflash get serial
+//    sudo ./kvflash del serial
+//    sudo ./kvflash list
+//    sudo ./kvflash gc
+//    sudo ./kvflash stats
+//
+// Region is the last KV_SIZE (256KB) of the detected chip, far behind the FPGA bitstream.
+// SPI bypass is enabled only while the store is scanned and updated.
+// The region changes all the time, so it is dropped from the scrub baseline (scrub.h).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "kvstore.h"
+#include "scrub.h"
+#include "util.h"
+
+static void usage(void) {
+  printf("Usage: kvflash set <key> <value> | get <key> | del <key> | list | gc | stats\n");
+}
+
+//
+// Main program
+//    kvflash <command> [key] [value]
+//
+int main(int argc, char* argv[]) {
+  const char* cmd = (argc > 1) ? argv[1] : "";
+  uint8_t val[KV_PAGE_SIZE + 1];
+  struct timespec t0;
+  uint32_t ms;
+  const struct flash_profile* chip;
+  uint16_t i;
+  int n;
+  int rc = 1;
+
+  if (!((strcmp(cmd, "set") == 0 && argc == 4) ||
+        ((strcmp(cmd, "get") == 0 || strcmp(cmd, "del") == 0) && argc == 3) ||
+        ((strcmp(cmd, "list") == 0 || strcmp(cmd, "gc") == 0 || strcmp(cmd, "stats") == 0) && argc == 2))) {
+    usage();
+    return 1;
+  }
+
+  if (!BOARD_open(GPIO_CHIP)) return 1;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    goto end_board;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+
+  BOARD_bypassEnable();
+  chip = IS25LP256_detect();
+  if (chip == NULL) {
+    printf("Unknown flash chip\n");
+    goto end_bypass;
+  }
+  SCRUB_load(SCRUB_BASELINE, chip->size);
+  if (SCRUB_invalidate(chip->size - KV_SIZE, KV_SIZE)) SCRUB_save(SCRUB_BASELINE);   // KV_open() 이 포맷할 수 있음
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (!KV_open(chip->size - KV_SIZE, KV_SIZE)) goto end_bypass;     // end of chip (16MB/8MB chips too)
+  printf("Store opened: %u keys, scan %u us\n", KV_count(), UTIL_elapsedUs(&t0));
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  if (strcmp(cmd, "set") == 0) {
+    if (KV_set(argv[2], argv[3], strlen(argv[3]))) {
+      printf("set %s (%u us)\n", argv[2], UTIL_elapsedUs(&t0));
+      rc = 0;
+    } else {
+      printf("set %s failed (key up to %u byte, key + value up to %u byte)\n", argv[2], KV_KEY_MAX,
+             KV_PAGE_SIZE - KV_RECORD_HDR);
+    }
+  } else if (strcmp(cmd, "get") == 0) {
+    n = KV_get(argv[2], val, KV_PAGE_SIZE);
+    if (n >= 0) {
+      val[n] = 0;
+      printf("%s\n", (char*)val);
+      rc = 0;
+    } else {
+      printf("%s not found\n", argv[2]);
+    }
+  } else if (strcmp(cmd, "del") == 0) {
+    if (KV_delete(argv[2])) rc = 0;
+    else printf("%s not found\n", argv[2]);
+  } else if (strcmp(cmd, "list") == 0) {
+    for (i = 0; i < KV_count(); i++) {
+      n = KV_get(KV_key(i), val, KV_PAGE_SIZE);
+      val[n] = 0;
+      printf("%s=%s\n", KV_key(i), (char*)val);
+    }
+    rc = 0;
+  } else if (strcmp(cmd, "gc") == 0) {
+    for (i = 0; KV_gcStep(); i++) ;
+    printf("%u sectors collected (%u us)\n", i, UTIL_elapsedUs(&t0));
+    rc = 0;
+  } else {
+    uint16_t nfree, total;
+    uint32_t live, erases;
+    KV_stats(&nfree, &total, &live, &erases);
+    printf("Sectors: %u free of %u, live %u bytes, max erase count %u\n", nfree, total, live, erases);
+    rc = 0;
+  }
+  KV_close();
+
+end_bypass:
+  ms = BOARD_bypassDisable();
+  printf("FPGA offline %u ms\n", ms);
+  IS25LP256_end();
+end_board:
+  BOARD_close();
+  return rc;
+}
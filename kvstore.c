@@ -0,0 +1,451 @@
+//
+// Log-structured key-value store in the unused area of SPI Flash
+//
+// Update of a value is one page program (sub-millisecond) appended at the head of the log.
+// A sector is erased only when the oldest sector is collected, and sectors are used
+// in circular order, so every sector is erased equally often.
+// One free sector is always kept in reserve, so live records of the oldest sector can be copied
+// even when the region is otherwise full.
+// Each erased sector gets an erase header at once, so erase counts of free sectors survive a reopen.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "IS25LP256.h"
+#include "crc32.h"
+#include "kvstore.h"
+
+#define SECTOR_MAGIC  "KVS1"
+#define ERASE_MAGIC   "KVSE"
+#define ERASE_HDR_POS 0               // erase header, written right after erase
+#define USE_HDR_POS   16              // sector header, written when the sector is allocated
+#define SECTOR_HDR    32              // first record
+#define RECORD_MAGIC  'K'
+#define TOMBSTONE     0xFFFF          // value length of deleted key
+
+enum { SECT_FREE, SECT_USED, SECT_BAD };
+
+struct sect_hdr {
+  char     magic[4];                  // SECTOR_MAGIC or ERASE_MAGIC
+  uint32_t seq;                       // allocation order (0xFFFFFFFF in erase header)
+  uint32_t erases;                    // erase count
+  uint32_t crc;                       // crc32 of fields above
+};
+
+struct rec_hdr {
+  uint8_t  magic;
+  uint8_t  klen;
+  uint16_t vlen;                      // TOMBSTONE for deleted key
+  uint32_t crc;                       // crc32 of klen, vlen, key, value
+};
+
+struct kv_sect {
+  uint8_t  state;
+  uint32_t seq;
+  uint32_t erases;
+  uint16_t used;                      // next append offset (KV_SECTOR_SIZE: closed)
+  uint16_t live;                      // bytes of records still in index
+};
+
+struct kv_entry {
+  char     key[KV_KEY_MAX + 1];
+  uint32_t addr;                      // flash address of record
+  uint16_t vlen;
+};
+
+static uint32_t _base;
+static uint16_t _nsect;
+static int      _active = -1;         // head sector of log
+static uint32_t _next_seq;
+static struct kv_sect _sect[KV_MAX_SECTORS];
+static struct kv_entry _index[KV_MAX_KEYS];
+static uint16_t _nkeys;
+static uint8_t  _sbuf[KV_SECTOR_SIZE];
+
+static uint16_t recSize(uint8_t klen, uint16_t vlen) {
+  return KV_RECORD_HDR + klen + (vlen == TOMBSTONE ? 0 : vlen);
+}
+
+static uint32_t recCrc(const uint8_t* rec) {
+  const struct rec_hdr* h = (const struct rec_hdr*)rec;
+  uint32_t crc = CRC32_update(0, &rec[1], 3);
+  return CRC32_update(crc, &rec[KV_RECORD_HDR], recSize(h->klen, h->vlen) - KV_RECORD_HDR);
+}
+
+static int findKey(const char* key) {
+  uint16_t i;
+  for (i = 0; i < _nkeys; i++) {
+    if (strcmp(_index[i].key, key) == 0) return i;
+  }
+  return -1;
+}
+
+static uint16_t sectOf(uint32_t addr) {
+  return (addr - _base) / KV_SECTOR_SIZE;
+}
+
+static bool hdrValid(const uint8_t* p, const char* magic) {
+  struct sect_hdr h;
+  memcpy(&h, p, sizeof(h));
+  return memcmp(h.magic, magic, 4) == 0 && h.crc == CRC32_update(0, (const uint8_t*)&h, 12);
+}
+
+static void hdrMake(struct sect_hdr* h, const char* magic, uint32_t seq, uint32_t erases) {
+  memcpy(h->magic, magic, 4);
+  h->seq = seq;
+  h->erases = erases;
+  h->crc = CRC32_update(0, (const uint8_t*)h, 12);
+}
+
+//
+// index 갱신 (scan 과 append 공통)
+// 이전 record 의 live 를 빼고, 새 record 를 등록 (tombstone 이면 삭제)
+//
+static bool applyRecord(const char* key, uint8_t klen, uint16_t vlen, uint32_t addr) {
+  int i = findKey(key);
+
+  if (i >= 0) _sect[sectOf(_index[i].addr)].live -= recSize(klen, _index[i].vlen);
+  if (vlen == TOMBSTONE) {
+    if (i >= 0) _index[i] = _index[--_nkeys];
+    return true;
+  }
+  if (i < 0) {
+    if (_nkeys == KV_MAX_KEYS) return false;
+    i = _nkeys++;
+    memcpy(_index[i].key, key, klen);
+    _index[i].key[klen] = 0;
+  }
+  _index[i].addr = addr;
+  _index[i].vlen = vlen;
+  _sect[sectOf(addr)].live += recSize(klen, vlen);
+  return true;
+}
+
+static uint16_t countFree(void) {
+  uint16_t i, n = 0;
+  for (i = 0; i < _nsect; i++) {
+    if (_sect[i].state == SECT_FREE) n++;
+  }
+  return n;
+}
+
+//
+// 섹터 지우기, 지운 뒤 바로 erase header (erase count) 를 쓴다. sector header 는 할당될 때 쓴다.
+// 반환값: true:정상 종료 false:지우기 실패 (섹터는 SECT_BAD 로 남아 쓰지 않음)
+//
+static bool eraseSect(uint16_t s) {
+  uint16_t sect_no = (_base + (uint32_t)s * KV_SECTOR_SIZE) / KV_SECTOR_SIZE;
+  struct sect_hdr h;
+
+  _sect[s].used = 0;
+  _sect[s].live = 0;
+  _sect[s].erases++;
+  if (!IS25LP256_eraseSector(sect_no, true)) {
+    printf("KV: erase failed at %08x\n", _base + (uint32_t)s * KV_SECTOR_SIZE);
+    _sect[s].state = SECT_BAD;
+    return false;
+  }
+  _sect[s].state = SECT_FREE;
+  hdrMake(&h, ERASE_MAGIC, 0xFFFFFFFF, _sect[s].erases);
+  IS25LP256_pageWrite(sect_no, ERASE_HDR_POS, (uint8_t*)&h, sizeof(h));   // 실패하면 다음 open 때 count 를 추정
+  return true;
+}
+
+//
+// 다음 head 섹터 할당 (현재 head 다음부터 원형 순서로 빈 섹터를 찾음)
+// reserve(in) : 남겨 두어야 하는 빈 섹터 수
+//
+static bool newSector(uint16_t reserve) {
+  struct sect_hdr h;
+  uint16_t i, s = 0;
+
+  if (countFree() <= reserve) return false;
+  for (i = 1; i <= _nsect; i++) {
+    s = (_active + i + _nsect) % _nsect;
+    if (_sect[s].state == SECT_FREE) break;
+  }
+  hdrMake(&h, SECTOR_MAGIC, _next_seq++, _sect[s].erases);
+  if (IS25LP256_pageWrite((_base + (uint32_t)s * KV_SECTOR_SIZE) / KV_SECTOR_SIZE, USE_HDR_POS, (uint8_t*)&h, sizeof(h)) == 0) return false;
+  if (_active >= 0) _sect[_active].used = KV_SECTOR_SIZE;    // close old head
+  _sect[s].state = SECT_USED;
+  _sect[s].seq = h.seq;
+  _sect[s].used = SECTOR_HDR;
+  _sect[s].live = 0;
+  _active = s;
+  return true;
+}
+
+//
+// head 에 record 추가 (1 page program)
+// rec(in) : header 와 key, value 가 채워진 record (crc 포함)
+// reserve(in) : 새 섹터가 필요할 때 남겨 두어야 하는 빈 섹터 수
+// 반환값: 쓴 flash 주소, 0: 공간 없음 또는 실패
+//
+static uint32_t append(uint8_t* rec, uint16_t reserve) {
+  uint16_t size = recSize(rec[1], ((struct rec_hdr*)rec)->vlen);
+  uint16_t pos = 0;
+
+  for (;;) {
+    if (_active >= 0) {
+      pos = _sect[_active].used;
+      if ((pos % KV_PAGE_SIZE) + size > KV_PAGE_SIZE) pos = (pos / KV_PAGE_SIZE + 1) * KV_PAGE_SIZE;   // page 를 넘지 않게
+      if (pos + size <= KV_SECTOR_SIZE) break;
+    }
+    if (!newSector(reserve)) return 0;
+  }
+  uint32_t addr = _base + (uint32_t)_active * KV_SECTOR_SIZE + pos;
+  if (IS25LP256_pageWrite(addr / KV_SECTOR_SIZE, addr % KV_SECTOR_SIZE, rec, size) == 0) return 0;
+  _sect[_active].used = pos + size;
+  return addr;
+}
+
+//
+// 가장 오래된 사용 중 섹터 (head 제외), 없으면 -1
+//
+static int oldest(void) {
+  int victim = -1;
+  uint16_t i;
+
+  for (i = 0; i < _nsect; i++) {
+    if (_sect[i].state != SECT_USED || (int)i == _active) continue;
+    if (victim < 0 || _sect[i].seq < _sect[victim].seq) victim = i;
+  }
+  return victim;
+}
+
+//
+// 가장 오래된 섹터 수집: live record 를 head 로 복사하고 지움
+// 반환값: true: 수집함, false: 대상 없음 또는 실패
+//
+static bool collect(void) {
+  uint8_t rec[KV_PAGE_SIZE];
+  int victim = oldest();
+  uint16_t i;
+
+  if (victim < 0) return false;
+
+  for (i = 0; i < _nkeys; i++) {
+    struct kv_entry* e = &_index[i];
+    uint16_t size = recSize(strlen(e->key), e->vlen);
+    uint32_t addr;
+    if (sectOf(e->addr) != victim) continue;
+    IS25LP256_fastread(e->addr, rec, size);
+    addr = append(rec, 0);          // 예비 섹터까지 사용 가능
+    if (addr == 0) return false;
+    _sect[victim].live -= size;
+    _sect[sectOf(addr)].live += size;
+    e->addr = addr;
+  }
+  // tombstone 은 복사하지 않는다 (더 오래된 섹터가 없으므로 가릴 record 가 없음)
+  return eraseSect(victim);
+}
+
+//
+// 섹터 하나 scan 해서 index 에 반영
+//
+static void scanSector(uint16_t s) {
+  uint16_t p = SECTOR_HDR;
+  char key[KV_KEY_MAX + 1];
+
+  IS25LP256_fastread(_base + (uint32_t)s * KV_SECTOR_SIZE, _sbuf, KV_SECTOR_SIZE);
+  while (p + KV_RECORD_HDR <= KV_SECTOR_SIZE) {
+    struct rec_hdr* h = (struct rec_hdr*)&_sbuf[p];
+    uint16_t size;
+
+    if (h->magic == 0xFF) {
+      // page 끝의 빈 공간이면 다음 page 에 record 가 있다
+      uint16_t q = (p / KV_PAGE_SIZE + 1) * KV_PAGE_SIZE;
+      if (p % KV_PAGE_SIZE == 0 || q >= KV_SECTOR_SIZE || _sbuf[q] == 0xFF) break;   // 끝
+      p = q;
+      continue;
+    }
+    size = recSize(h->klen, h->vlen);
+    if (h->magic != RECORD_MAGIC || h->klen == 0 || h->klen > KV_KEY_MAX ||
+        (p % KV_PAGE_SIZE) + size > KV_PAGE_SIZE || h->crc != recCrc(&_sbuf[p])) {
+      // 쓰는 도중 전원이 꺼진 record, 이 섹터에는 더 이상 추가하지 않음
+      p = KV_SECTOR_SIZE;
+      break;
+    }
+    memcpy(key, &_sbuf[p + KV_RECORD_HDR], h->klen);
+    key[h->klen] = 0;
+    applyRecord(key, h->klen, h->vlen, _base + (uint32_t)s * KV_SECTOR_SIZE + p);
+    p += size;
+  }
+  _sect[s].used = p;
+}
+
+static bool badRegion(uint32_t base, uint32_t size) {
+  return base % KV_SECTOR_SIZE || size % KV_SECTOR_SIZE || size / KV_SECTOR_SIZE < 3 ||
+         size / KV_SECTOR_SIZE > KV_MAX_SECTORS || (uint64_t)base + size > IS25LP256_profile()->size;
+}
+
+//
+// store 가 있는지 확인 (각 섹터의 header 32 byte 만 읽음, 아무것도 지우지 않음)
+//
+bool KV_probe(uint32_t base, uint32_t size) {
+  uint8_t hdr[SECTOR_HDR];
+  uint32_t a;
+
+  if (badRegion(base, size)) return false;
+  for (a = base; a < base + size; a += KV_SECTOR_SIZE) {
+    IS25LP256_fastread(a, hdr, SECTOR_HDR);
+    if (hdrValid(&hdr[USE_HDR_POS], SECTOR_MAGIC) || hdrValid(&hdr[ERASE_HDR_POS], ERASE_MAGIC)) return true;
+  }
+  return false;
+}
+
+//
+// store 열기, 전체 섹터 scan 후 index 재구성
+// erase count 는 sector header, 없으면 erase header 에서 읽는다. 둘 다 없는 빈 섹터는 알려진 최대값으로 본다.
+//
+bool KV_open(uint32_t base, uint32_t size) {
+  uint16_t order[KV_MAX_SECTORS];
+  bool known[KV_MAX_SECTORS];
+  uint32_t max_erases = 0;
+  uint16_t i, j, nused = 0;
+
+  if (badRegion(base, size)) {
+    printf("KV_open: bad region %08x + %x\n", base, size);
+    return false;
+  }
+  _base = base;
+  _nsect = size / KV_SECTOR_SIZE;
+  _nkeys = 0;
+  _active = -1;
+  _next_seq = 0;
+  memset(_sect, 0, sizeof(_sect));
+
+  // 섹터 header 확인
+  for (i = 0; i < _nsect; i++) {
+    struct sect_hdr h;
+    IS25LP256_fastread(_base + (uint32_t)i * KV_SECTOR_SIZE, _sbuf, KV_SECTOR_SIZE);
+    known[i] = true;
+    if (hdrValid(&_sbuf[USE_HDR_POS], SECTOR_MAGIC)) {
+      memcpy(&h, &_sbuf[USE_HDR_POS], sizeof(h));
+      _sect[i].state = SECT_USED;
+      _sect[i].seq = h.seq;
+      _sect[i].erases = h.erases;
+      if (h.seq >= _next_seq) _next_seq = h.seq + 1;
+      // sequence 순서로 정렬 (삽입 정렬)
+      for (j = nused++; j > 0 && _sect[order[j-1]].seq > h.seq; j--) order[j] = order[j-1];
+      order[j] = i;
+    } else {
+      // erase header 뒤가 모두 0xFF 이면 빈 섹터, 아니면 쓰거나 지우는 도중 전원이 꺼진 섹터
+      j = hdrValid(&_sbuf[ERASE_HDR_POS], ERASE_MAGIC) ? USE_HDR_POS : 0;
+      if (j) memcpy(&h, &_sbuf[ERASE_HDR_POS], sizeof(h));
+      known[i] = (j != 0);
+      _sect[i].erases = known[i] ? h.erases : 0;
+      for (; j < KV_SECTOR_SIZE && _sbuf[j] == 0xFF; j++) ;
+      _sect[i].state = (j == KV_SECTOR_SIZE) ? SECT_FREE : SECT_BAD;
+    }
+    if (_sect[i].erases > max_erases) max_erases = _sect[i].erases;
+  }
+  for (i = 0; i < _nsect; i++) {
+    if (!known[i]) _sect[i].erases = max_erases;
+  }
+
+  // 오래된 섹터부터 적용하면 나중 record 가 이긴다
+  for (i = 0; i < nused; i++) scanSector(order[i]);
+  if (nused > 0) _active = order[nused - 1];
+
+  // 지우는 도중 전원이 꺼진 섹터
+  for (i = 0; i < _nsect; i++) {
+    if (_sect[i].state == SECT_BAD) eraseSect(i);
+  }
+  return true;
+}
+
+void KV_close(void) {
+  _nkeys = 0;
+  _nsect = 0;
+  _active = -1;
+}
+
+int KV_get(const char* key, void* buf, uint16_t size) {
+  int i = findKey(key);
+  if (i < 0) return -1;
+  if (size > _index[i].vlen) size = _index[i].vlen;
+  IS25LP256_fastread(_index[i].addr + KV_RECORD_HDR + strlen(key), (uint8_t*)buf, size);
+  return _index[i].vlen;
+}
+
+//
+// record 만들어서 추가
+// 수집은 평소 idle 때 KV_gcStep() (flashd) 이 하므로, 여기서는 예비 섹터밖에 남지 않았을 때만 수집한다.
+//
+static bool put(const char* key, const void* val, uint16_t vlen) {
+  uint8_t rec[KV_PAGE_SIZE];
+  struct rec_hdr* h = (struct rec_hdr*)rec;
+  uint16_t klen = strlen(key);
+  uint16_t tries;
+  uint32_t addr;
+
+  h->magic = RECORD_MAGIC;
+  h->klen = klen;
+  h->vlen = vlen;
+  memcpy(&rec[KV_RECORD_HDR], key, klen);
+  if (vlen != TOMBSTONE) memcpy(&rec[KV_RECORD_HDR + klen], val, vlen);
+  h->crc = recCrc(rec);
+
+  // 예비 섹터 1개는 수집용으로 남긴다
+  for (tries = 0; (addr = append(rec, 1)) == 0; tries++) {
+    if (tries >= _nsect || !collect()) {
+      printf("KV: store is full\n");
+      return false;
+    }
+  }
+  return applyRecord(key, klen, vlen, addr);
+}
+
+bool KV_set(const char* key, const void* val, uint16_t len) {
+  uint8_t old[KV_PAGE_SIZE];
+  uint16_t klen = strlen(key);
+  int i;
+
+  if (klen == 0 || klen > KV_KEY_MAX || KV_RECORD_HDR + klen + len > KV_PAGE_SIZE) return false;
+  if (findKey(key) < 0 && _nkeys == KV_MAX_KEYS) return false;
+
+  // 값이 같으면 쓰지 않음
+  i = KV_get(key, old, sizeof(old));
+  if (i == len && memcmp(old, val, len) == 0) return true;
+  return put(key, val, len);
+}
+
+bool KV_delete(const char* key) {
+  if (findKey(key) < 0) return false;
+  return put(key, NULL, TOMBSTONE);
+}
+
+bool KV_gcPending(void) {
+  int victim = oldest();
+
+  if (_nsect == 0 || victim < 0) return false;
+  // 빈 섹터가 1/4 이하이거나, 가장 오래된 섹터에 live data 가 없으면 수집
+  return countFree() <= _nsect / 4 || _sect[victim].live == 0;
+}
+
+bool KV_gcStep(void) {
+  return KV_gcPending() && collect();
+}
+
+uint16_t KV_count(void) {
+  return _nkeys;
+}
+
+const char* KV_key(uint16_t i) {
+  return (i < _nkeys) ? _index[i].key : NULL;
+}
+
+void KV_stats(uint16_t* nfree, uint16_t* total, uint32_t* live, uint32_t* max_erases) {
+  uint16_t i;
+  *nfree = countFree();
+  *total = _nsect;
+  *live = 0;
+  *max_erases = 0;
+  for (i = 0; i < _nsect; i++) {
+    *live += _sect[i].live;
+    if (_sect[i].erases > *max_erases) *max_erases = _sect[i].erases;
+  }
+}
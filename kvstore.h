@@ -0,0 +1,66 @@
+//
+// Log-structured key-value store in the unused area of SPI Flash
+//
+// Small, frequently updated parameters (calibration, board serial, counters) are appended
+// as records with one page program, no sector erase is needed for an update.
+// The store is a circular log of 4KB sectors:
+//    sector = erase header(16 byte: "KVSE", -, erase count, crc)     written right after erase
+//           + sector header(16 byte: "KVS1", sequence, erase count, crc) written when allocated
+//           + records
+//    record = header(8 byte: 'K', key length, value length, crc32) + key + value
+// Records never cross a page. The newest record of a key wins, a deleted key is written as a tombstone.
+// Sectors are used in circular order (wear leveling), and the oldest sector is collected
+// (live records copied to the head, then erased) one sector at a time, in idle time by flashd.
+// An update collects by itself only when the reserve sector is the last free one.
+// The in-RAM index is rebuilt by scanning the region at KV_open().
+//
+// SPI bypass must be enabled by the caller while these functions are used.
+//
+
+#define KV_SIZE         0x00040000   // default region: last 256KB of the chip (bitstream uses about 3.6MB)
+#define KV_SECTOR_SIZE  4096
+#define KV_PAGE_SIZE    256
+#define KV_MAX_SECTORS  256          // region up to 1MB
+#define KV_MAX_KEYS     256
+#define KV_KEY_MAX      32           // maximum key length
+#define KV_RECORD_HDR   8
+#define KV_VALUE_MAX    (KV_PAGE_SIZE - KV_RECORD_HDR - 1)   // maximum value length (key + value <= 248 byte)
+
+// Check if a store is in the region (sector headers only, nothing is erased)
+bool KV_probe(uint32_t base, uint32_t size);
+
+// Open store at base (sector aligned), size (multiple of sector, 3 sectors or more).
+// Scan all sectors and rebuild index, erase sectors broken by power loss.
+// Return: true:success false:failure
+bool KV_open(uint32_t base, uint32_t size);
+
+// Close store (index is dropped)
+void KV_close(void);
+
+// Read value of key
+// buf(out) : value (up to size byte)
+// Return: length of value, -1 if not found
+int KV_get(const char* key, void* buf, uint16_t size);
+
+// Write value of key (one page program, no write if value is not changed)
+// Return: true:success false:failure (too long, index or region full)
+bool KV_set(const char* key, const void* val, uint16_t len);
+
+// Delete key (tombstone record). Return: true:success false:not found or failure
+bool KV_delete(const char* key);
+
+// Check if the oldest sector should be collected (free sectors are running low or it has no live data)
+// No flash access, so it can be polled without SPI bypass.
+bool KV_gcPending(void);
+
+// Background garbage collection, call when idle
+// Collect the oldest sector if KV_gcPending().
+// Return: true if a sector was collected (call again), false if nothing to do
+bool KV_gcStep(void);
+
+// Number of keys, and key by index (0 ~ KV_count()-1) for listing
+uint16_t KV_count(void);
+const char* KV_key(uint16_t i);
+
+// Statistics (free sectors, total sectors, live bytes, maximum erase count)
+void KV_stats(uint16_t* nfree, uint16_t* total, uint32_t* live, uint32_t* max_erases);
@@ -0,0 +1,207 @@
+//
+// Multi-image layout (*.layout), one pass write with merged erase plan
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IS25LP256.h"
+#include "layout.h"
+#include "util.h"
+
+#define SECTORS_PER_BLOCK (LAYOUT_BLOCK_SIZE / LAYOUT_SECTOR_SIZE)
+#define PAGE_SIZE         256
+#define FULL_MASK         0xFFFF     // 16 sectors of a block
+
+static uint8_t _buf[LAYOUT_BLOCK_SIZE];     // composed block
+static uint8_t _cur[LAYOUT_BLOCK_SIZE];     // flash contents
+
+bool LAYOUT_isLayout(const char* path) {
+  size_t n = strlen(path), k = strlen(LAYOUT_SUFFIX);
+  return n > k && strcmp(&path[n - k], LAYOUT_SUFFIX) == 0;
+}
+
+static int byOffset(const void* a, const void* b) {
+  const struct layout_entry* x = (const struct layout_entry*)a;
+  const struct layout_entry* y = (const struct layout_entry*)b;
+  return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+//
+// layout 파일 읽기, 이미지 로드, 정렬 및 겹침 확인
+// 반환값: true:정상 종료 false:실패
+//
+bool LAYOUT_open(const char* path, struct layout* l) {
+  char line[512], file[256], dir[256] = "";
+  const char* slash = strrchr(path, '/');
+  long long offset;
+  uint32_t lineno = 0, i;
+  FILE* fp;
+
+  memset(l, 0, sizeof(*l));
+  if (slash) snprintf(dir, sizeof(dir), "%.*s/", (int)(slash - path), path);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    perror("Error opening layout");
+    return false;
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    char* hash = strchr(line, '#');
+    lineno++;
+    if (hash) *hash = 0;
+    if (sscanf(line, "%255s", file) != 1) continue;      // 빈 줄
+    if (sscanf(line, "%255s %lli", file, &offset) != 2 || offset < 0) {
+      printf("LAYOUT_open: line %u: file and offset expected\n", lineno);
+      goto fail;
+    }
+    if (l->n == LAYOUT_MAX_ENTRIES) {
+      printf("LAYOUT_open: more than %u images\n", LAYOUT_MAX_ENTRIES);
+      goto fail;
+    }
+    if (offset > UINT32_MAX) {
+      printf("LAYOUT_open: line %u: offset %llx is beyond 4GB\n", lineno, offset);
+      goto fail;
+    }
+    if (offset % LAYOUT_SECTOR_SIZE != 0) {
+      printf("LAYOUT_open: line %u: offset %08llx is not sector (4KB) aligned\n", lineno, offset);
+      goto fail;
+    }
+    snprintf(l->e[l->n].path, sizeof(l->e[l->n].path), "%s%s", (file[0] == '/') ? "" : dir, file);
+    l->e[l->n].offset = offset;
+    l->e[l->n].data = UTIL_readFile(l->e[l->n].path, &l->e[l->n].size);
+    if (l->e[l->n++].data == NULL) goto fail;
+    if (l->e[l->n - 1].size == 0) {
+      printf("LAYOUT_open: %s is empty\n", l->e[l->n - 1].path);
+      goto fail;
+    }
+    if ((uint64_t)offset + l->e[l->n - 1].size > UINT32_MAX) {      // 32bit 주소 계산이 넘치지 않게
+      printf("LAYOUT_open: line %u: %s at %08llx ends beyond 4GB\n", lineno, l->e[l->n - 1].path, offset);
+      goto fail;
+    }
+  }
+  fclose(fp);
+  fp = NULL;
+  if (l->n == 0) {
+    printf("LAYOUT_open: no image in layout\n");
+    goto fail;
+  }
+
+  qsort(l->e, l->n, sizeof(l->e[0]), byOffset);
+  for (i = 0; i + 1 < l->n; i++) {
+    if ((uint64_t)l->e[i].offset + l->e[i].size > l->e[i + 1].offset) {
+      printf("LAYOUT_open: %s (%08x-%08x) overlaps %s (%08x)\n", l->e[i].path, l->e[i].offset,
+             l->e[i].offset + l->e[i].size - 1, l->e[i + 1].path, l->e[i + 1].offset);
+      goto fail;
+    }
+  }
+  return true;
+
+fail:
+  if (fp) fclose(fp);
+  LAYOUT_close(l);
+  return false;
+}
+
+void LAYOUT_close(struct layout* l) {
+  uint32_t i;
+  for (i = 0; i < l->n; i++) free(l->e[i].data);
+  memset(l, 0, sizeof(*l));
+}
+
+uint32_t LAYOUT_start(const struct layout* l) {
+  return l->e[0].offset;
+}
+
+uint32_t LAYOUT_end(const struct layout* l) {
+  const struct layout_entry* e = &l->e[l->n - 1];
+  return (e->offset + e->size + LAYOUT_SECTOR_SIZE - 1) / LAYOUT_SECTOR_SIZE * LAYOUT_SECTOR_SIZE;
+}
+
+//
+// 64KB block 한 개의 내용 만들기 (이미지가 없는 곳과 이미지 끝 섹터의 나머지는 0xFF)
+// 반환값: 이미지가 덮는 섹터의 bit mask (bit0: block 의 첫 섹터)
+//
+static uint16_t compose(const struct layout* l, uint32_t blk_addr, uint8_t* buf) {
+  uint16_t mask = 0;
+  uint32_t i, s, from, to;
+
+  memset(buf, 0xFF, LAYOUT_BLOCK_SIZE);
+  for (i = 0; i < l->n; i++) {
+    const struct layout_entry* e = &l->e[i];
+    if (e->offset >= blk_addr + LAYOUT_BLOCK_SIZE || e->offset + e->size <= blk_addr) continue;
+    from = (e->offset > blk_addr) ? e->offset : blk_addr;
+    to = (e->offset + e->size < blk_addr + LAYOUT_BLOCK_SIZE) ? e->offset + e->size : blk_addr + LAYOUT_BLOCK_SIZE;
+    memcpy(&buf[from - blk_addr], &e->data[from - e->offset], to - from);
+    for (s = (from - blk_addr) / LAYOUT_SECTOR_SIZE; s <= (to - 1 - blk_addr) / LAYOUT_SECTOR_SIZE; s++) mask |= 1 << s;
+  }
+  return mask;
+}
+
+void LAYOUT_plan(const struct layout* l, uint32_t* blocks, uint32_t* sectors) {
+  uint32_t blk;
+  uint16_t mask;
+
+  *blocks = *sectors = 0;
+  for (blk = LAYOUT_start(l) & ~(LAYOUT_BLOCK_SIZE - 1); blk < LAYOUT_end(l); blk += LAYOUT_BLOCK_SIZE) {
+    mask = compose(l, blk, _buf);
+    if (mask == FULL_MASK) (*blocks)++;
+    else *sectors += __builtin_popcount(mask);
+  }
+}
+
+//
+// block 단위로 지우고 쓰기 (erase-as-you-go, 두 이미지가 나눠 쓰는 block 도 한번만 지운다)
+//
+bool LAYOUT_program(const struct layout* l) {
+  uint32_t blk, s, pg, k;
+  uint16_t mask;
+
+  for (blk = LAYOUT_start(l) & ~(LAYOUT_BLOCK_SIZE - 1); blk < LAYOUT_end(l); blk += LAYOUT_BLOCK_SIZE) {
+    mask = compose(l, blk, _buf);
+    if (mask == 0) continue;
+    if (mask == FULL_MASK) IS25LP256_erase64Block(blk / LAYOUT_BLOCK_SIZE, true);
+    else {
+      for (s = 0; s < SECTORS_PER_BLOCK; s++) {
+        if (mask & (1 << s)) IS25LP256_eraseSector(blk / LAYOUT_SECTOR_SIZE + s, true);
+      }
+    }
+    for (s = 0; s < SECTORS_PER_BLOCK; s++) {
+      if (!(mask & (1 << s))) continue;
+      for (pg = s * LAYOUT_SECTOR_SIZE; pg < (s + 1) * LAYOUT_SECTOR_SIZE; pg += PAGE_SIZE) {
+        for (k = 0; k < PAGE_SIZE && _buf[pg + k] == 0xFF; k++) ;
+        if (k < PAGE_SIZE && IS25LP256_write(blk + pg, &_buf[pg], PAGE_SIZE) != PAGE_SIZE) {
+          printf("LAYOUT_program: program failed at %08x\n", blk + pg);
+          return false;
+        }
+      }
+    }
+    if (blk % 0x40000 == 0) printf("Written %08x\n", blk);
+  }
+  return true;
+}
+
+//
+// 검증: 덮는 섹터만 읽어서 비교 (block 당 연속 구간 한번씩 읽음)
+//
+bool LAYOUT_verify(const struct layout* l) {
+  uint32_t blk, s, first, bad = 0;
+  uint16_t mask;
+
+  for (blk = LAYOUT_start(l) & ~(LAYOUT_BLOCK_SIZE - 1); blk < LAYOUT_end(l); blk += LAYOUT_BLOCK_SIZE) {
+    mask = compose(l, blk, _buf);
+    for (s = 0; s < SECTORS_PER_BLOCK; ) {
+      if (!(mask & (1 << s))) { s++; continue; }
+      for (first = s; s < SECTORS_PER_BLOCK && (mask & (1 << s)); s++) ;
+      IS25LP256_fastread(blk + first * LAYOUT_SECTOR_SIZE, &_cur[first * LAYOUT_SECTOR_SIZE], (s - first) * LAYOUT_SECTOR_SIZE);
+      for (; first < s; first++) {
+        if (memcmp(&_cur[first * LAYOUT_SECTOR_SIZE], &_buf[first * LAYOUT_SECTOR_SIZE], LAYOUT_SECTOR_SIZE) != 0) {
+          if (bad < 16) printf("Verify failed at sector %04x (%08x)\n", blk / LAYOUT_SECTOR_SIZE + first, blk + first * LAYOUT_SECTOR_SIZE);
+          bad++;
+        }
+      }
+    }
+  }
+  return bad == 0;
+}
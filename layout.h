@@ -0,0 +1,56 @@
+//
+// Multi-image layout (*.layout)
+//
+// Text file with one image per line, '#' starts a comment:
+//    # file                          offset
+//    golden.bin                      0x000000
+//    SMI_v2.2_240613_1xSPI.bin       0x800000
+//    data.bin                        0x1F00000
+// Relative paths are taken from the directory of the layout file.
+// Offsets must be sector (4KB) aligned and images must not overlap.
+//
+// All images are written in one pass, block by block in address order: a 64KB block which is
+// completely covered (even by two images) is erased once as a block, otherwise only covered sectors
+// are erased. Sectors between images are not touched. The end of an image is padded with 0xFF
+// to its sector. One verify pass follows the write.
+//
+
+#define LAYOUT_SUFFIX       ".layout"
+#define LAYOUT_MAX_ENTRIES  16
+#define LAYOUT_SECTOR_SIZE  4096
+#define LAYOUT_BLOCK_SIZE   65536
+
+struct layout_entry {
+  char     path[512];
+  uint32_t offset;               // flash address (sector aligned)
+  uint32_t size;                 // bytes of image
+  uint8_t* data;                 // whole image in memory
+};
+
+// Layout opened by LAYOUT_open(), entries sorted by offset
+struct layout {
+  uint32_t            n;
+  struct layout_entry e[LAYOUT_MAX_ENTRIES];
+};
+
+// Check if the file is a layout (by suffix)
+bool LAYOUT_isLayout(const char* path);
+
+// Parse layout, load all images and check alignment and overlaps. Return: true:success false:failure
+bool LAYOUT_open(const char* path, struct layout* l);
+
+// Free images
+void LAYOUT_close(struct layout* l);
+
+// First and end (exclusive, sector aligned) flash address covered by the layout
+uint32_t LAYOUT_start(const struct layout* l);
+uint32_t LAYOUT_end(const struct layout* l);
+
+// Merged erase plan: number of 64KB block erases and 4KB sector erases
+void LAYOUT_plan(const struct layout* l, uint32_t* blocks, uint32_t* sectors);
+
+// Erase and program all images, block by block. Return: true:success false:failure
+bool LAYOUT_program(const struct layout* l);
+
+// Verify all images by one read of covered sectors. Return: true:success false:failure
+bool LAYOUT_verify(const struct layout* l);
@@ -18,26 +18,24 @@
 #include <string.h>
 #include <unistd.h>
 #include <termios.h>
-#include <sys/ioctl.h>
-#include <linux/spi/spidev.h>
-#include <gpiod.h>        // GPIO control using libgpiod Library
-#include <wiringPiSPI.h>  // SPI control using WiringPi Library
-#include "IS25LP256.h"    // Custom made library for SPI Flash operation through SPI0 channel
+#include <time.h>
+#include <ctype.h>
+#include <limits.h>
+#include "IS25LP256.h"    // Custom made library for SPI Flash operation through SPI0 channel (/dev/spidev ioctl)
+#include "board.h"        // GPIO control (SPI bypass, FPGA reconfiguration) using libgpiod Library
+#include "pkg.h"          // Update package (*.pkg) with precomputed sector manifest
+#include "patch.h"        // Binary patch (*.patch) applied to the old image in flash
+#include "layout.h"       // Several images at their own offsets (*.layout) in one pass
+#include "scrub.h"        // Sector CRC baseline for the background scrubber (scrubflash)
+#include "rt.h"           // Real-time mode (SCHED_FIFO, CPU pinning, mlockall) and page program latency
+#include "kvstore.h"      // Key-value store at the end of the chip (kvflash), never overwritten here
+#include "util.h"         // File loading, timing and state directory shared by the tools
+
+#define FILENAME "./SMI_v2.2_240613_1xSPI.bin"		// Default binary file (*.bin), package (*.pkg) or patch (*.patch) to be written to SPI Flash memory
 
-#define SPI_CHANNEL 0   // /dev/spidev0.0
-
-#define GPIO_CHIP "gpiochip0"
-#define GPIO_14_ROM_UPDATE_EN	14		// ROM_UPDATE_EN
-#define GPIO_07_SLEEP_EN	07		// SLEEP_EN
-
-
-#define FILENAME "./SMI_v2.2_240613_1xSPI.bin"		// Binaray file name to be written to SPI Flash memory
-
-#define SPI_MODE  0          // SPI mode among 0, 1, 2 or 3
-#define SPI_DEVICE "/dev/spidev0.0"  // SPI channel 0
-#define SPI_SPEED_HZ 10000000	// SPI clock speed at 10MHz
 #define CHUNK_SIZE 256			// unit amount per write operation
 #define SECTOR_SIZE 4096    // unit amount of one sector
+#define BLOCK_SIZE 65536    // unit amount of one 64KB block
 
 
 //
@@ -115,244 +113,427 @@ void wait_for_space() {
 
 
 
-
 //
-// Main program
-//    1. Read ROM binary file
-//    2. Read JEDEC ID of Flash memeory
-//    3. Pause and wait for space bar
+// FLASH_RT=cpu[,prio] 해석 (10진수만, 뒤에 다른 문자가 있으면 틀린 값)
+// cpu(out), prio(out) : cpu -1 은 pinning 없음, prio 가 없으면 RT_PRIO
+// 반환값: true: 올바른 값, false: 틀린 값
 //
-int main() {
-    struct gpiod_chip *chip;
-    struct gpiod_line *line;
-    int ret;
-  
-    uint8_t jedc[3];      // JEDEC-ID (3byte, MF7-MF0 ID15-ID8 ID7-ID0)
-    uint8_t buf[CHUNK_SIZE];     // acquired data, 256byte
-    uint8_t wdata[CHUNK_SIZE];   // data to be written, 256byte (Maximum 256byte by Input Page Write command)
-    uint8_t i;            // general variable, unsigned 8bit
-    uint16_t ii;          // general variable, unsigned 16bit
-    uint16_t n;           // return value or number of data read
-  
-    ssize_t bytes_read;
-  
-    int start_addr=0x00;    // start address for write
-  
-    uint16_t s_sect_no=start_addr>>12;  // start sector number for Input Page Write
-    uint16_t s_blk32_no=start_addr>>15;  // start block32 number for Input Page Write
-    uint16_t s_blk64_no=start_addr>>16;  // start block64 number for Input Page Write
+static bool parse_rt(const char* s, int* cpu, int* prio) {
+    char* end;
+    long v;
+
+    if (!isdigit((unsigned char)*s) && strncmp(s, "-1", 2) != 0) return false;
+    v = strtol(s, &end, 10);
+    if (v < -1 || v > INT_MAX) return false;
+    *cpu = (int)v;
+    *prio = RT_PRIO;
+    if (*end == 0) return true;
+    if (*end != ',' || !isdigit((unsigned char)end[1])) return false;
+    s = end + 1;
+    v = strtol(s, &end, 10);
+    if (*end != 0 || v < 1 || v > 99) return false;
+    *prio = (int)v;
+    return true;
+}
 
-    uint32_t s_addr=start_addr;         // assign start address at 32bit variable
+//
+// Erase one unit just before filling it, then program and verify it
+// 64KB block erase if the unit is a whole aligned block, otherwise one 4KB sector.
+// Pages which are all 0xFF are not programmed (already erased).
+// addr(in) : flash address of unit (sector aligned)
+// data(in) : data of unit
+// len(in)  : bytes, BLOCK_SIZE or up to SECTOR_SIZE (shorter only at the end of data)
+// 반환값: true: verify OK, false: verify NG
+//
+static bool write_unit(uint32_t addr, const uint8_t* data, uint32_t len) {
+    uint8_t buf[SECTOR_SIZE];
+    uint32_t offset, k;
 
+    if (len == BLOCK_SIZE && (addr % BLOCK_SIZE) == 0) IS25LP256_erase64Block(addr >> 16, true);
+    else IS25LP256_eraseSector(addr >> 12, true);
 
-    // Open binary file for reading
-    FILE* binaryFile = fopen(FILENAME, "rb");
-    if (binaryFile == NULL) {
-        perror("Error opening file");
-        return 1;
+    for (offset = 0; offset < len; offset += CHUNK_SIZE) {
+      uint32_t n = (len - offset < CHUNK_SIZE) ? len - offset : CHUNK_SIZE;
+      for (k = 0; k < n && data[offset + k] == 0xFF; k++) ;
+      if (k < n) IS25LP256_write(addr + offset, &data[offset], n);   // page program latency 는 IS25LP256_write 가 잰다
     }
 
-    // Get the file size (Check manually if file is open normally)
-    size_t fileSize;
-    fseek(binaryFile, 0, SEEK_END);
-    fileSize = ftell(binaryFile);
-    printf ("File size: %d\n",fileSize);
-    fseek(binaryFile, 0, SEEK_SET);
-
-    // Open GPIO chip
-    chip = gpiod_chip_open_by_name(GPIO_CHIP);
-    if (!chip) {
-        perror("Failed to open GPIO chip");
-        return 1;
+    // Verify by reading back before going on to the next unit
+    for (offset = 0; offset < len; offset += SECTOR_SIZE) {
+      uint32_t n = (len - offset < SECTOR_SIZE) ? len - offset : SECTOR_SIZE;
+      IS25LP256_fastread(addr + offset, buf, n);
+      if (memcmp(buf, &data[offset], n) != 0) {
+        printf("Verify failed at %08x\n", addr + offset);
+        return false;
+      }
     }
+    SCRUB_set(addr, data, len);   // baseline of the scrubber
+    return true;
+}
 
+//
+// Length of next erase unit at addr when avail bytes of data are ready
+// Whole 64KB block if aligned and enough data, otherwise up to the next sector boundary.
+//
+static uint32_t unit_len(uint32_t addr, uint32_t avail) {
+    uint32_t len;
+    if ((addr % BLOCK_SIZE) == 0 && avail >= BLOCK_SIZE) return BLOCK_SIZE;
+    len = SECTOR_SIZE - (addr % SECTOR_SIZE);
+    return (avail < len) ? avail : len;
+}
 
+//
+// Erase, write and verify raw binary image (*.bin), erase-as-you-go
+// Each unit is erased just before it is filled, so at most one unit is blank at a time,
+// and erasing stops at the real end of the image.
+// image(in) : whole image in memory
+// size(in)  : bytes of image
+// s_addr(in): start address for write (sector aligned)
+// 반환값: true: verify OK, false: verify NG
+//
+static bool write_bin(const uint8_t* image, uint32_t size, uint32_t s_addr) {
+    uint32_t offset, len;
 
+    for (offset = 0; offset < size; offset += len) {
+      len = unit_len(s_addr + offset, size - offset);
+      if (!write_unit(s_addr + offset, &image[offset], len)) return false;
+      if ((s_addr + offset) % 0x40000 == 0) printf("Written %08x\n", s_addr + offset);
+    }
+    printf("Write is done!!! %u bytes\n", size);
+    return true;
+}
 
+//
+// Erase, write and verify image of unknown length from a stream (pipe), erase-as-you-go
+// Data is read 64KB at a time, so one unit is always complete before it is erased.
+// fp(in)    : input stream
+// s_addr(in): start address for write (sector aligned)
+// limit(in) : maximum bytes (end of writable area - s_addr)
+// 반환값: true: verify OK, false: verify NG or read error or image too large
+//
+static bool write_stream(FILE* fp, uint32_t s_addr, uint32_t limit) {
+    static uint8_t data[BLOCK_SIZE];
+    uint32_t total = 0;
+    uint32_t avail = 0;      // bytes in data[]
+    uint32_t head = 0;       // first byte not yet written
+    uint32_t len;
+    bool eof = false;
+
+    while (!eof || head < avail) {
+      // 64KB 가 모이도록 채운다 (pipe 는 짧게 읽힐 수 있음, fread 가 EOF 까지 기다림)
+      if (!eof && avail - head < BLOCK_SIZE) {
+        memmove(data, &data[head], avail - head);
+        avail -= head;
+        head = 0;
+        avail += fread(&data[avail], 1, BLOCK_SIZE - avail, fp);
+        if (avail < BLOCK_SIZE) {
+          if (ferror(fp)) {
+            perror("Error reading stream");
+            return false;
+          }
+          eof = true;
+        }
+      }
+      if (head == avail) break;
+      len = unit_len(s_addr + total, avail - head);
+      if (total + len > limit) {
+        printf("Image does not fit in flash\n");
+        return false;
+      }
+      if (!write_unit(s_addr + total, &data[head], len)) return false;
+      if ((s_addr + total) % 0x40000 == 0) printf("Written %08x\n", s_addr + total);
+      head += len;
+      total += len;
+    }
+    printf("Write is done!!! %u bytes\n", total);
+    return total > 0;
+}
+
+//
+// Plan, write and verify update package (*.pkg) from its sector manifest
+// Only changed sectors are erased and programmed, payload is streamed from file.
+// 반환값: true: verify OK, false: verify NG
+//
+static bool write_pkg(struct pkg* p) {
+    uint8_t* changed = (uint8_t*)malloc(p->hdr.nsectors);
+    uint32_t cnt;
+    bool ok;
+
+    if (changed == NULL) return false;
+    cnt = PKG_plan(p, changed);
+    printf("Plan: %u of %u sectors to be written\n", cnt, p->hdr.nsectors);
+    ok = (cnt == 0) || PKG_program(p, changed);
+    if (ok) printf("Write is done!!!\n");
+    free(changed);
+    return ok && PKG_verify(p);
+}
 
-    // Get GPIO 07 line.
-    // GPIO_07_SLEEP_EN (Active high)
-    line = gpiod_chip_get_line(chip, GPIO_07_SLEEP_EN);
-    if (!line) {
-        perror("Failed to get GPIO line");
-        gpiod_chip_close(chip);
-        return 1;
+//
+// Apply binary patch (*.patch) to the old image in flash, and verify
+// Flash must hold the old image (or already the new one, or a partly applied patch, which is resumed).
+// Only changed sectors are written.
+// 반환값: true: verify OK, false: verify NG or old image not found
+//
+static bool write_patch(struct patch* p) {
+    uint32_t cnt = 0;
+    int st = PATCH_check(p);
+
+    if (st == 1) {
+      printf("New image is already in flash\n");
+      return true;
+    }
+    if (st < 0) {
+      printf("Flash holds neither the old image of this patch nor a resumable partly applied one\n");
+      return false;
     }
+    if (st == 2) {
+      uint32_t t = p->hdr.target_offset;
+      printf("Patch was partly applied, resuming at %08x\n",
+             p->resume ? (t / PATCH_BLOCK_SIZE + p->resume) * PATCH_BLOCK_SIZE : t);
+    }
+    if (!PATCH_apply(p, &cnt)) return false;
+    printf("Write is done!!! %u sectors written\n", cnt);
+    return PATCH_verify(p);
+}
 
-    // Request GPIO line
-    ret = gpiod_line_request_output(line, "gpio-control", 0);
-    if (ret < 0) {
-        perror("Failed to request GPIO line");
-        gpiod_chip_close(chip);
-        return 1;
+//
+// Write all images of a layout (*.layout) with one merged erase plan, then verify in one pass
+// 반환값: true: verify OK, false: verify NG
+//
+static bool write_layout(struct layout* l) {
+    uint32_t i;
+
+    if (!LAYOUT_program(l)) return false;
+    printf("Write is done!!! %u images\n", l->n);
+    if (!LAYOUT_verify(l)) return false;
+    for (i = 0; i < l->n; i++) SCRUB_set(l->e[i].offset, l->e[i].data, l->e[i].size);   // baseline of the scrubber
+    return true;
+}
+
+//
+// Main program
+//    main [file.bin | file.pkg | file.patch | file.layout | -]
+//    1. Read ROM binary file into memory, or manifest of update package
+//       ("-": image of unknown length is streamed from stdin while writing, no pause at 3.)
+//    2. Read JEDEC ID of Flash memeory (short bypass window)
+//    3. Pause and wait for space bar
+//    4. Erase, write and verify (one bypass window, no pause inside)
+//    5. Reconfigure FPGA from the new image
+// FLASH_RT=cpu[,prio] runs 4. in real-time mode (rt.h). Page program latency is reported either way.
+//
+int main(int argc, char* argv[]) {
+    const char* filename = (argc > 1) ? argv[1] : FILENAME;
+    uint8_t jedc[3];      // JEDEC-ID (3byte, MF7-MF0 ID15-ID8 ID7-ID0)
+    uint8_t uid[16];      // Unique ID (16byte)
+    uint8_t buf[SECTOR_SIZE];    // acquired data
+    uint8_t i;            // general variable, unsigned 8bit
+    uint16_t n;           // return value or number of data read
+    uint32_t ms;          // FPGA offline time of a bypass window
+    uint32_t s_end;       // end of writable area (start of the key-value store, if any)
+    bool has_kv = false;
+    bool verified = false;
+    uint8_t* image = NULL;
+    struct pkg pkg;
+    struct patch patch;
+    struct layout layout;
+    bool is_stream = (strcmp(filename, "-") == 0);
+    bool is_pkg = !is_stream && PKG_isPackage(filename);
+    bool is_patch = !is_stream && !is_pkg && PATCH_isPatch(filename);
+    bool is_layout = !is_stream && !is_pkg && !is_patch && LAYOUT_isLayout(filename);
+    size_t fileSize = 0;
+    int rc = 1;
+  
+    int start_addr=0x00;    // start address for write
+
+    if (is_stream) {
+        // Stream: size is unknown, data is read while writing
+        printf("Image is streamed from stdin\n");
+    } else if (is_layout) {
+        // Layout: all images are loaded, and written in one pass with a merged erase plan
+        uint32_t nblk, nsect;
+        if (!LAYOUT_open(filename, &layout)) return 1;
+        start_addr = LAYOUT_start(&layout);
+        fileSize = LAYOUT_end(&layout) - start_addr;
+        for (i = 0; i < layout.n; i++) {
+            printf("  %08x-%08x  %s\n", layout.e[i].offset, layout.e[i].offset + layout.e[i].size - 1, layout.e[i].path);
+        }
+        LAYOUT_plan(&layout, &nblk, &nsect);
+        printf("Layout: %u images, plan %u block and %u sector erases\n", layout.n, nblk, nsect);
+    } else if (is_patch) {
+        // Patch: ops are streamed from file while the new image is rebuilt from flash
+        if (!PATCH_open(filename, &patch)) return 1;
+        fileSize = patch.hdr.new_size;
+        start_addr = patch.hdr.target_offset;
+        printf("Patch: %u -> %u bytes at %08x, %u ops\n",
+               patch.hdr.old_size, patch.hdr.new_size, start_addr, patch.hdr.nops);
+    } else if (is_pkg) {
+        // Package: only manifest is loaded, payload is streamed while writing
+        if (!PKG_open(filename, &pkg)) return 1;
+        fileSize = pkg.hdr.image_size;
+        start_addr = pkg.hdr.target_offset;
+        printf("Package: image %zu bytes at %08x, %u sectors, %u ranges\n",
+               fileSize, start_addr, pkg.hdr.nsectors, pkg.hdr.nranges);
+    } else {
+        // Read whole image before bypass, so that no file I/O is done while FPGA is offline
+        uint32_t size;
+        image = UTIL_readFile(filename, &size);
+        if (image == NULL) return 1;
+        fileSize = size;
+        printf ("File size: %zu\n",fileSize);
     }
 
+    uint32_t s_addr=start_addr;         // assign start address at 32bit variable
+
+    // Open GPIO chip and request ROM_UPDATE_EN, SLEEP_EN, PROGRAM_B and INIT_B lines
+    if (!BOARD_open(GPIO_CHIP)) goto end_file;
+
     // Test of GPIO 07 (High - Enable Sleep --> Clock power down)
-    gpiod_line_set_value(line, 1);
+    BOARD_setSleep(true);
     printf("Sleep Enabled!\n\n");
 
     usleep(100000);  //sleep 0.1sec
 
     // Test of GPIO 07 (Low - Disable Sleep --> Clock operation)
-    gpiod_line_set_value(line, 0);
+    BOARD_setSleep(false);
     printf("Sleep Disabled!\n\n");
 
 
+    printf("Setup SPI0 channel\n");
 
-
-
-
-    // Get GPIO 14 line.
-    // GPIO_14_ROM_UPDATE_EN (Active high)
-    line = gpiod_chip_get_line(chip, GPIO_14_ROM_UPDATE_EN);
-    if (!line) {
-        perror("Failed to get GPIO line");
-        gpiod_chip_close(chip);
-        return 1;
+    // Begin of flash memory
+    // Open /dev/spidev0.0 and set mode and speed once
+    if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+      printf("SPISetup failed:\n");
+      goto end_board;
     }
+    IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
 
-    // Request GPIO line
-    ret = gpiod_line_request_output(line, "gpio-control", 0);
-    if (ret < 0) {
-        perror("Failed to request GPIO line");
-        gpiod_chip_close(chip);
-        return 1;
-    }
 
-    // Test of GPIO 14 (Low - Disable ROM Update)
-    gpiod_line_set_value(line, 0); // Set line low (0V)
-    printf("SPI Bypass Disabled!\n\n");
+    // Bypass window 1: identify the chip only
+    BOARD_bypassEnable();
 
-    usleep(100000);  //sleep 0.1sec
+    // Read JEDEC ID (It must be 9d 60 19 (3 byte)) and SFDP, select chip profile
+    IS25LP256_readManufacturer(jedc);
+    const struct flash_profile* chip = IS25LP256_detect();
+    if (chip != NULL) has_kv = KV_probe(chip->size - KV_SIZE, KV_SIZE);
 
-    // Test of GPIO 14 (High - Enable ROM Update)
-    gpiod_line_set_value(line, 1); // Set line high (3.3V)
-    printf("SPI Bypass Enabled!\n\n");
-	
-	
-	
-		
-	
-	
-	
-	
-	
-	
-    printf("Setup SPI0 channel\n");
-  
-    // Start SPI channel 0 with pre-defined speed
-    if (wiringPiSPISetupMode(SPI_CHANNEL, SPI_SPEED_HZ, SPI_MODE) < 0) {
-      printf("SPISetup failed:\n");
-      return 1;
-    }
+    // Unique ID 획득 (16 byte, every memory chip has a distinct or unique value)
+    IS25LP256_readUniqieID(uid);
 
+    // Read current stored data
+    // 256 byte from address s_addr
+    memset(buf,0,256);  // clear temporary buffer
+    n =  IS25LP256_read(s_addr, buf, 256);
 
-    // Begin of flash memory
-    IS25LP256_begin(SPI_CHANNEL);
+    ms = BOARD_bypassDisable();
+    printf("SPI Bypass window: FPGA offline %u ms\n", ms);
 
-    // Read JEDEC ID (It must be 9d 60 19 (3 byte))
-    IS25LP256_readManufacturer(jedc);
     printf("\nJEDEC ID : ");
     for (i=0; i< 3; i++) {
       printf("%02X ",jedc[i]);
     }
     printf("\n");
-    
-    // Unique ID 획득 (16 byte, every memory chip has a distinct or unique value)
-    IS25LP256_readUniqieID(buf);
+    if (chip == NULL) {
+      printf("Unknown flash chip (no matching JEDEC ID or SFDP)\n");
+      goto end_spi;
+    }
+    printf("Flash chip: %s, %u bytes, page %u, %u-byte address, fast read %02Xh\n",
+           chip->name, chip->size, chip->page_size, chip->addr_bytes, chip->cmd_fastread);
+    if (s_addr + fileSize > chip->size || s_addr % SECTOR_SIZE) {
+      printf("Image does not fit in flash\n");
+      goto end_spi;
+    }
+    s_end = has_kv ? chip->size - KV_SIZE : chip->size;
+    if (s_addr + fileSize > s_end || s_addr >= s_end) {
+      printf("Image overlaps the key-value store at %08x (kvflash), not written\n", s_end);
+      goto end_spi;
+    }
+    SCRUB_load(SCRUB_BASELINE, chip->size);
+    if (is_pkg && (pkg.hdr.jedec[0] | pkg.hdr.jedec[1] | pkg.hdr.jedec[2]) && memcmp(pkg.hdr.jedec, jedc, 3) != 0) {
+      printf("Package is made for JEDEC ID %02X %02X %02X\n", pkg.hdr.jedec[0], pkg.hdr.jedec[1], pkg.hdr.jedec[2]);
+      goto end_spi;
+    }
+    if (is_patch && (patch.hdr.jedec[0] | patch.hdr.jedec[1] | patch.hdr.jedec[2]) && memcmp(patch.hdr.jedec, jedc, 3) != 0) {
+      printf("Patch is made for JEDEC ID %02X %02X %02X\n", patch.hdr.jedec[0], patch.hdr.jedec[1], patch.hdr.jedec[2]);
+      goto end_spi;
+    }
     printf("Unique ID : ");
     for (i=0; i< 16; i++) {
-      printf("%02X ",buf[i]);
+      printf("%02X ",uid[i]);
     }
     printf("\n");
-  
-    // Read current stored data
-    // 256 byte from address s_addr
-    memset(buf,0,256);  // clear temporary buffer
-    n =  IS25LP256_read(s_addr, buf, 256);
     printf("Read Data: n=%d\n",n);
     dump(buf,256);
   
-    printf("We will start to erase 4MB...\n");
-    wait_for_space(); // Program waits here for space bar press
-    printf("Erase 4MB is started...\n\n");
-
-//  Erase All. It takes about 1 minute.
-//    n = IS25LP256_eraseAll(true);
-//    printf("Erase All: n=%d\n",n);
-
-    // Erase first 4MB using Block(64kB) erase for 64 times.
-    // It is because the size of binary file is 3,825,788 byte (3.64MB) which is less than 4MB.
-    // It takes about 8 sec.
-    for (ii=0; ii<64; ii++){
-      n = IS25LP256_erase64Block(ii, true);
+    if (is_stream) {
+      // stdin is the image, so there is no pause. FPGA stays offline until the stream ends.
+      printf("We will start to erase, write and verify the stream at %08x...\n", s_addr);
+    } else {
+      printf("We will start to erase, write and verify %zu bytes at %08x...\n", fileSize, s_addr);
+      wait_for_space(); // Program waits here for space bar press, FPGA is online
     }
-  
-    // Check if erase is done
-    memset(buf,0,256);  // clear temporary buffer
-    n =  IS25LP256_read (0, buf, 256);
-    dump(buf,256);
-  
-    printf("Erase 4MB is done!!!\n\n");
-  
-    wait_for_space(); // Program waits here for space bar press
 
-  
-    // write BIN file in SPI Flash memory
-    ssize_t read_bytes;
-    uint32_t flash_address = 0; // Start address in SPI Flash where data will be written
-    uint16_t sector_no = 0;
-    uint16_t int_addr = 0;  //internal address within a sector (total 4096byte)
-    uint8_t k=0;
-  
-    while ((read_bytes = fread(buf, 1, CHUNK_SIZE, binaryFile)) > 0) {
 
-//      dump(buf,256);
-      
-      if (int_addr == SECTOR_SIZE){
-        int_addr=0;  //initialize int_addr
-      }
+    // 쓰는 동안 끊겨도 scrubber 가 예전 baseline 으로 검사/복구하지 않도록 먼저 빼 둔다
+    // (검증된 unit 은 write_unit 이 다시 넣음, stream 은 길이를 모르므로 쓸 수 있는 끝까지)
+    SCRUB_invalidate(s_addr, is_stream ? s_end - s_addr : fileSize);
+    SCRUB_save(SCRUB_BASELINE);
 
-      sector_no = flash_address>>12;
-      
-      n = IS25LP256_pageWrite(sector_no, int_addr, buf, CHUNK_SIZE);
+    // Real-time mode for the write (FLASH_RT=cpu[,prio]), FPGA offline time is kept short and even
+    const char* rt = getenv(RT_ENV);
+    int rt_cpu, rt_prio;
+    if (rt && !parse_rt(rt, &rt_cpu, &rt_prio))
+      printf("%s=%s: expected cpu[,prio] (prio 1-99), latency is measured in normal mode\n", RT_ENV, rt);
+    else if (rt && !RT_enable(rt_cpu, rt_prio))
+      printf("%s=%s: not in real-time mode, latency is measured in normal mode\n", RT_ENV, rt);
+    RT_latReset();
 
-      if (flash_address%0x40000==0){
-        printf("sector no = %04x  int_addr = %04x read bytes = %d  write bytes = %d\n", sector_no, int_addr, read_bytes, n-4);
-      }
-
-      // increase internal address within Sector(4KB)
-      int_addr += CHUNK_SIZE;
-      
-      // increase flash address (full address)
-      flash_address += read_bytes;
+    // Bypass window 2: erase, write and verify without any pause
+    BOARD_bypassEnable();
 
-    }
+    if (is_stream) verified = write_stream(stdin, s_addr, s_end - s_addr);
+    else if (is_layout) verified = write_layout(&layout);
+    else if (is_patch) verified = write_patch(&patch);
+    else if (is_pkg) verified = write_pkg(&pkg);
+    else verified = write_bin(image, fileSize, s_addr);
 
-    printf("Write is done!!!\n\n");
-    wait_for_space(); // Program waits here for space bar press
- 
-  
-    // Read current stored data
-    // 512 byte from address 0x00
+    // Read current stored data, 256 byte from address s_addr
     memset(buf,0,256);  // clear temporary buffer
-    n =  IS25LP256_read(0, buf, 256);
-    printf("Read Data: n=%d\n",n);
-    dump(buf,256);
+    n =  IS25LP256_read(s_addr, buf, 256);
 
-    memset(buf,0,256);  // clear temporary buffer
-    n =  IS25LP256_read(256, buf, 256);
+    // Get fron Status Register1
+    uint8_t status = IS25LP256_readStatusReg();
+
+    // Disable SPI0 Bypass lines
+    ms = BOARD_bypassDisable();
+    RT_disable();
+    printf("SPI Bypass Disabled! FPGA offline %u ms (total %u ms)\n\n", ms, BOARD_offlineTotal());
+    RT_latReport("Page program latency");
+
+    printf("Verify: %s\n", verified ? "OK" : "NG");
+    // pkg/patch 는 이미지 전체가 메모리에 없으므로 다음 scrub 때 flash 에서 baseline 을 가져온다
+    if (verified && (is_pkg || is_patch)) SCRUB_adopt(s_addr, fileSize);
+    SCRUB_save(SCRUB_BASELINE);
+    printf("Status Register: %X\n",status);
     printf("Read Data: n=%d\n",n);
     dump(buf,256);
-  
 
-    // Get fron Status Register1
-    buf[0] = IS25LP256_readStatusReg();
-    printf("Status Register: %X\n",buf[0]);
+    // Load new image into FPGA without power cycle
+    if (verified) {
+      if (!BOARD_canReconfigure()) printf("Power cycle the board to load the new image (no valid %s)\n", BOARD_RECONFIG_ENV);
+      else if (BOARD_reconfigure(BOARD_RECONFIG_TIMEOUT_MS)) printf("FPGA reconfiguration started\n");
+      else printf("FPGA reconfiguration failed\n");
+      rc = 0;
+    }
 
-    // Disable SPI0 Bypass lines
-    gpiod_line_set_value(line, 0); // Set FLASH_EN (GPIO 14) line low (0V)
-    printf("SPI Bypass Disabled!\n\n");
-  
-    return 0;
+end_spi:
+    IS25LP256_end();
+end_board:
+    BOARD_close();
+end_file:
+    if (is_pkg) PKG_close(&pkg);
+    if (is_patch) PATCH_close(&patch);
+    if (is_layout) LAYOUT_close(&layout);
+    free(image);
+    return rc;
 }
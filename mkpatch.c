@@ -0,0 +1,268 @@
+//
+// Make binary patch (*.patch) from old and new ROM binary files (*.bin)
+// Runs on the build host, no SPI/GPIO is used.
+//
+//    mkpatch [-o target_offset] [-j JEDEC_ID] old.bin new.bin output.patch
+//    ex) mkpatch -j 9D6019 SMI_v2.1.bin SMI_v2.2_240613_1xSPI.bin SMI_v2.1-v2.2.patch
+//
+// Greedy matching like bsdiff/rsync: every 16-byte window of the old image is indexed,
+// and at each position of the new image the longest match (same offset, previous copy
+// offset, or hash candidates) becomes a COPY op. Unmatched bytes become LITERAL ops,
+// long runs of one value become FILL ops.
+// A COPY source must not be in an old sector which is rewritten before its destination
+// sector (the flasher applies the patch in place, in address order).
+// Each 64KB block of the new image gets a digest, so the flasher can resume an interrupted apply.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "patch.h"
+#include "util.h"
+
+#define WINDOW      16           // bytes of indexed window
+#define HASH_BITS   20
+#define MAX_CHAIN   32           // candidates tried per position
+#define MIN_COPY    24           // shorter matches are sent as literal
+#define MIN_FILL    64           // shorter runs are sent as literal
+
+static uint8_t* _old;
+static uint8_t* _new;
+static uint32_t _old_size, _new_size;
+static uint32_t _offset;         // flash address of the images
+static bool* _changed;           // old sector is rewritten by the patch
+
+static uint8_t* _body;           // ops and literal data
+static size_t _body_len, _body_cap;
+static uint32_t _nops;
+static uint32_t _copy_bytes, _lit_bytes, _fill_bytes;
+
+static void bodyAppend(const void* data, size_t n) {
+  if (_body_len + n > _body_cap) {
+    _body_cap = (_body_len + n) * 2;
+    _body = (uint8_t*)realloc(_body, _body_cap);
+    if (_body == NULL) {
+      printf("Out of memory\n");
+      exit(1);
+    }
+  }
+  memcpy(&_body[_body_len], data, n);
+  _body_len += n;
+}
+
+static void emit(uint8_t type, uint32_t len, uint32_t src, uint8_t fill, const uint8_t* literal) {
+  struct patch_op op;
+
+  memset(&op, 0, sizeof(op));
+  op.type = type;
+  op.fill = fill;
+  op.len = len;
+  op.src = src;
+  bodyAppend(&op, sizeof(op));
+  if (literal) bodyAppend(literal, len);
+  _nops++;
+}
+
+static uint32_t hashAt(const uint8_t* p) {
+  uint32_t h = 0;
+  uint8_t i;
+  for (i = 0; i < WINDOW; i++) h = h * 257 + p[i];
+  return (h * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Old byte at s may be copied to new position q (in place rule)
+static bool allowed(uint32_t s, uint32_t q) {
+  uint32_t ss = s / PATCH_SECTOR_SIZE;
+  return !_changed[ss] || ss >= q / PATCH_SECTOR_SIZE;
+}
+
+static uint32_t matchLen(uint32_t s, uint32_t q) {
+  uint32_t n = 0;
+  while (q + n < _new_size && s + n < _old_size && _old[s + n] == _new[q + n] && allowed(s + n, q + n)) n++;
+  return n;
+}
+
+static void usage(void) {
+  printf("usage: mkpatch [-o target_offset] [-j JEDEC_ID] old.bin new.bin output.patch\n");
+}
+
+int main(int argc, char* argv[]) {
+  struct patch_header h;
+  uint32_t jedec = 0;
+  uint8_t* blocks;               // block digests
+  uint8_t* blk;
+  uint32_t padded, start, len, nblocks;
+  struct sha256_ctx ctx;
+  int32_t* head;
+  int32_t* next;
+  int32_t delta = 0;             // src - dst of last copy
+  uint32_t nsect, nchanged = 0;
+  uint32_t i, p, lit_start;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:j:")) != -1) {
+    switch (opt) {
+    case 'o': _offset = strtoul(optarg, NULL, 0); break;
+    case 'j': jedec = strtoul(optarg, NULL, 16); break;
+    default: usage(); return 1;
+    }
+  }
+  if (argc - optind != 3) {
+    usage();
+    return 1;
+  }
+  if (_offset % PATCH_SECTOR_SIZE != 0) {
+    printf("target offset must be sector (4KB) aligned\n");
+    return 1;
+  }
+  _old = UTIL_readFile(argv[optind], &_old_size);
+  _new = UTIL_readFile(argv[optind + 1], &_new_size);
+  if (_old == NULL || _new == NULL) return 1;
+  if (_new_size == 0) {
+    printf("new image is empty\n");
+    return 1;
+  }
+
+  // Sectors rewritten by the flasher: content differs (new image padded with 0xFF),
+  // or contents of flash are not known (behind the end of old image)
+  nsect = ((_old_size > _new_size ? _old_size : _new_size) + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE;
+  _changed = (bool*)calloc(nsect, sizeof(bool));
+  for (i = 0; i < nsect; i++) {
+    uint32_t off = i * PATCH_SECTOR_SIZE, k;
+    if (off >= _new_size) break;                  // flasher does not touch sectors behind the new image
+    if (off + PATCH_SECTOR_SIZE > _old_size) _changed[i] = true;
+    for (k = 0; k < PATCH_SECTOR_SIZE && !_changed[i]; k++) {
+      uint8_t nb = (off + k < _new_size) ? _new[off + k] : 0xFF;
+      if (_old[off + k] != nb) _changed[i] = true;
+    }
+    if (_changed[i]) nchanged++;
+  }
+
+  // Index of old image windows (newest first in chain)
+  head = (int32_t*)malloc(sizeof(int32_t) << HASH_BITS);
+  next = (int32_t*)malloc(sizeof(int32_t) * (_old_size + 1));
+  if (_changed == NULL || head == NULL || next == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+  memset(head, 0xFF, sizeof(int32_t) << HASH_BITS);
+  for (i = 0; i + WINDOW <= _old_size; i++) {
+    uint32_t hv = hashAt(&_old[i]);
+    next[i] = head[hv];
+    head[hv] = i;
+  }
+
+  // Greedy matching
+  lit_start = 0;
+  for (p = 0; p < _new_size; ) {
+    uint32_t best_len = 0, best_src = 0, len, run;
+    int32_t s;
+    uint16_t chain = 0;
+
+    // same offset, then offset of last copy
+    if (p < _old_size && (len = matchLen(p, p)) > best_len) { best_len = len; best_src = p; }
+    if ((int64_t)p + delta >= 0 && p + delta < _old_size && (len = matchLen(p + delta, p)) > best_len) {
+      best_len = len;
+      best_src = p + delta;
+    }
+    if (best_len < 4096 && p + WINDOW <= _new_size) {
+      for (s = head[hashAt(&_new[p])]; s >= 0 && chain < MAX_CHAIN; s = next[s], chain++) {
+        if ((len = matchLen(s, p)) > best_len) { best_len = len; best_src = s; }
+      }
+    }
+    for (run = 1; p + run < _new_size && _new[p + run] == _new[p]; run++) ;
+
+    if (best_len >= MIN_COPY || (run >= MIN_FILL && run > best_len)) {
+      if (lit_start < p) {
+        emit(PATCH_LITERAL, p - lit_start, 0, 0, &_new[lit_start]);
+        _lit_bytes += p - lit_start;
+      }
+      if (run >= MIN_FILL && run > best_len) {
+        emit(PATCH_FILL, run, 0, _new[p], NULL);
+        _fill_bytes += run;
+        p += run;
+      } else {
+        emit(PATCH_COPY, best_len, best_src, 0, NULL);
+        _copy_bytes += best_len;
+        delta = (int32_t)best_src - (int32_t)p;
+        p += best_len;
+      }
+      lit_start = p;
+    } else {
+      p++;
+    }
+  }
+  if (lit_start < _new_size) {
+    emit(PATCH_LITERAL, _new_size - lit_start, 0, 0, &_new[lit_start]);
+    _lit_bytes += _new_size - lit_start;
+  }
+
+  // Digest of each block of the new image as it is in flash (64KB aligned, padded with 0xFF to its sector)
+  padded = (_new_size + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE * PATCH_SECTOR_SIZE;
+  nblocks = (_offset + padded - 1) / PATCH_BLOCK_SIZE - _offset / PATCH_BLOCK_SIZE + 1;
+  blocks = (uint8_t*)malloc((size_t)nblocks * SHA256_SIZE);
+  blk = (uint8_t*)malloc(PATCH_BLOCK_SIZE);
+  if (blocks == NULL || blk == NULL) {
+    printf("Out of memory\n");
+    return 1;
+  }
+  for (i = 0, start = 0; start < padded; i++, start += len) {
+    len = PATCH_BLOCK_SIZE - (_offset + start) % PATCH_BLOCK_SIZE;
+    if (len > padded - start) len = padded - start;
+    memset(blk, 0xFF, len);
+    memcpy(blk, &_new[start], (_new_size - start < len) ? _new_size - start : len);
+    SHA256_digest(blk, len, &blocks[i * SHA256_SIZE]);
+  }
+
+  // Header
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, PATCH_MAGIC, 8);
+  h.version = PATCH_VERSION;
+  h.header_size = PATCH_HEADER_SIZE;
+  h.target_offset = _offset;
+  h.old_size = _old_size;
+  h.new_size = _new_size;
+  h.nops = _nops;
+  h.nblocks = nblocks;
+  h.jedec[0] = (jedec >> 16) & 0xFF;
+  h.jedec[1] = (jedec >> 8) & 0xFF;
+  h.jedec[2] = jedec & 0xFF;
+  SHA256_digest(_old, _old_size, h.old_sha256);
+  SHA256_digest(_new, _new_size, h.new_sha256);
+  SHA256_init(&ctx);
+  SHA256_update(&ctx, blocks, (size_t)nblocks * SHA256_SIZE);
+  SHA256_update(&ctx, _body, _body_len);
+  SHA256_final(&ctx, h.body_sha256);
+
+  // Write patch
+  FILE* out = fopen(argv[optind + 2], "wb");
+  if (out == NULL) {
+    perror("Error opening output");
+    return 1;
+  }
+  fwrite(&h, sizeof(h), 1, out);
+  fwrite(blocks, SHA256_SIZE, h.nblocks, out);
+  fwrite(_body, 1, _body_len, out);
+  if (fclose(out) != 0) {
+    perror("Error writing output");
+    return 1;
+  }
+
+  printf("Old %u bytes, new %u bytes, %u of %u sectors changed, target %08x\n",
+         _old_size, _new_size, nchanged, (_new_size + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE, _offset);
+  printf("%u ops: copy %u, literal %u, fill %u bytes, %u blocks, patch %zu bytes\n",
+         _nops, _copy_bytes, _lit_bytes, _fill_bytes, h.nblocks, sizeof(h) + (size_t)h.nblocks * SHA256_SIZE + _body_len);
+  free(_old);
+  free(_new);
+  free(_changed);
+  free(_body);
+  free(blocks);
+  free(blk);
+  free(head);
+  free(next);
+  return 0;
+}
@@ -0,0 +1,137 @@
+//
+// Make update package (*.pkg) from ROM binary file (*.bin)
+// Runs on the build host, no SPI/GPIO is used.
+//
+//    mkpkg [-o target_offset] [-j JEDEC_ID] input.bin output.pkg
+//    ex) mkpkg -o 0 -j 9D6019 SMI_v2.2_240613_1xSPI.bin SMI_v2.2_240613_1xSPI.pkg
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "sha256.h"
+#include "pkg.h"
+#include "util.h"
+
+static bool isBlank(const uint8_t* p, uint32_t n) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    if (p[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+static void usage(void) {
+  printf("usage: mkpkg [-o target_offset] [-j JEDEC_ID] input.bin output.pkg\n");
+}
+
+int main(int argc, char* argv[]) {
+  struct pkg_header h;
+  struct sha256_ctx ctx;
+  uint32_t jedec = 0;
+  uint32_t offset = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:j:")) != -1) {
+    switch (opt) {
+    case 'o': offset = strtoul(optarg, NULL, 0); break;
+    case 'j': jedec = strtoul(optarg, NULL, 16); break;
+    default: usage(); return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    return 1;
+  }
+  if (offset % PKG_SECTOR_SIZE != 0) {
+    printf("target offset must be sector (4KB) aligned\n");
+    return 1;
+  }
+
+  // Read image, padded with 0xFF to sector size
+  uint32_t size;
+  uint8_t* image = UTIL_readFile(argv[optind], &size);
+  if (image == NULL) return 1;
+  uint32_t nsectors = (size + PKG_SECTOR_SIZE - 1) / PKG_SECTOR_SIZE;
+  image = (uint8_t*)realloc(image, (size_t)nsectors * PKG_SECTOR_SIZE + 1);
+  if (image == NULL) {
+    perror("Error reading file");
+    return 1;
+  }
+  memset(&image[size], 0xFF, (size_t)nsectors * PKG_SECTOR_SIZE - size);
+
+  // Sector table
+  struct pkg_sector* sectors = (struct pkg_sector*)calloc(nsectors, sizeof(struct pkg_sector));
+  uint32_t i;
+  for (i = 0; i < nsectors; i++) {
+    SHA256_digest(&image[i * PKG_SECTOR_SIZE], PKG_SECTOR_SIZE, sectors[i].sha256);
+    if (isBlank(&image[i * PKG_SECTOR_SIZE], PKG_SECTOR_SIZE)) sectors[i].flags |= PKG_SECTOR_BLANK;
+  }
+
+  // Range table: consecutive non-blank pages
+  uint32_t npages = (size + PKG_PAGE_SIZE - 1) / PKG_PAGE_SIZE;
+  struct pkg_range* ranges = (struct pkg_range*)calloc(npages, sizeof(struct pkg_range));
+  uint32_t nranges = 0, payload = 0;
+  for (i = 0; i < npages; i++) {
+    uint32_t off = i * PKG_PAGE_SIZE;
+    uint32_t len = (size - off < PKG_PAGE_SIZE) ? size - off : PKG_PAGE_SIZE;
+    if (isBlank(&image[off], len)) continue;
+    if (nranges > 0 && ranges[nranges-1].offset + ranges[nranges-1].length == off) {
+      ranges[nranges-1].length += len;
+    } else {
+      ranges[nranges].offset = off;
+      ranges[nranges].length = len;
+      nranges++;
+    }
+    payload += len;
+  }
+
+  // Header
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, PKG_MAGIC, 8);
+  h.version = PKG_VERSION;
+  h.header_size = PKG_HEADER_SIZE;
+  h.target_offset = offset;
+  h.image_size = size;
+  h.sector_size = PKG_SECTOR_SIZE;
+  h.nsectors = nsectors;
+  h.nranges = nranges;
+  h.payload_offset = PKG_HEADER_SIZE + nsectors * sizeof(struct pkg_sector) + nranges * sizeof(struct pkg_range);
+  h.jedec[0] = (jedec >> 16) & 0xFF;
+  h.jedec[1] = (jedec >> 8) & 0xFF;
+  h.jedec[2] = jedec & 0xFF;
+  SHA256_digest(image, size, h.image_sha256);
+
+  SHA256_init(&ctx);
+  SHA256_update(&ctx, &h, sizeof(h));
+  SHA256_update(&ctx, sectors, sizeof(struct pkg_sector) * nsectors);
+  SHA256_update(&ctx, ranges, sizeof(struct pkg_range) * nranges);
+  SHA256_final(&ctx, h.manifest_sha256);
+
+  // Write package
+  FILE* out = fopen(argv[optind + 1], "wb");
+  if (out == NULL) {
+    perror("Error opening output");
+    return 1;
+  }
+  fwrite(&h, sizeof(h), 1, out);
+  fwrite(sectors, sizeof(struct pkg_sector), nsectors, out);
+  fwrite(ranges, sizeof(struct pkg_range), nranges, out);
+  for (i = 0; i < nranges; i++) {
+    fwrite(&image[ranges[i].offset], 1, ranges[i].length, out);
+  }
+  if (fclose(out) != 0) {
+    perror("Error writing output");
+    return 1;
+  }
+
+  printf("Image %u bytes, %u sectors, %u ranges, payload %u bytes, target %08x\n",
+         size, nsectors, nranges, payload, offset);
+  free(image);
+  free(sectors);
+  free(ranges);
+  return 0;
+}
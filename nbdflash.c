@@ -0,0 +1,368 @@
+//
+// Expose SPI Flash as a local NBD(Network Block Device) through a Unix socket
+//
+// Standard tools (dd, cmp, sha256sum) can be used directly against the FPGA flash.
+//    sudo ./nbdflash /tmp/spiflash.sock
+//    sudo nbd-client -unix /tmp/spiflash.sock /dev/nbd0
+//    sudo sha256sum /dev/nbd0
+//    sudo nbd-client -d /dev/nbd0
+//
+// Reads use the 64KB read cache, writes are merged by the write-back sector cache (flashio.c),
+// TRIM erases sector aligned ranges. SPI bypass is enabled only while a client is connected.
+// Written and trimmed sectors are dropped from the scrub baseline (scrub.h) before they change,
+// build it again with "scrubflash -B" or by writing with main if they should be scrubbed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "flashio.h"
+#include "scrub.h"
+#include "util.h"
+
+#define NBD_SOCKET "/tmp/spiflash.sock"
+#define NBD_EXPORT "spiflash"
+
+// NBD protocol (fixed newstyle handshake)
+#define NBDMAGIC              0x4e42444d41474943ULL
+#define IHAVEOPT              0x49484156454F5054ULL
+#define NBD_OPT_REPLY_MAGIC   0x0003e889045565a9ULL
+#define NBD_REQUEST_MAGIC     0x25609513
+#define NBD_SIMPLE_REPLY_MAGIC 0x67446698
+
+#define NBD_FLAG_FIXED_NEWSTYLE 0x0001
+#define NBD_FLAG_NO_ZEROES      0x0002
+#define NBD_FLAG_C_NO_ZEROES    0x0002
+
+#define NBD_FLAG_HAS_FLAGS    0x0001
+#define NBD_FLAG_SEND_FLUSH   0x0004
+#define NBD_FLAG_SEND_FUA     0x0008
+#define NBD_FLAG_SEND_TRIM    0x0020
+
+#define NBD_OPT_EXPORT_NAME   1
+#define NBD_OPT_ABORT         2
+#define NBD_OPT_LIST          3
+#define NBD_OPT_INFO          6
+#define NBD_OPT_GO            7
+
+#define NBD_REP_ACK           1
+#define NBD_REP_SERVER        2
+#define NBD_REP_INFO          3
+#define NBD_REP_ERR_UNSUP     0x80000001
+
+#define NBD_INFO_EXPORT       0
+#define NBD_INFO_BLOCK_SIZE   3
+
+#define NBD_CMD_READ          0
+#define NBD_CMD_WRITE         1
+#define NBD_CMD_DISC          2
+#define NBD_CMD_FLUSH         3
+#define NBD_CMD_TRIM          4
+#define NBD_CMD_FLAG_FUA      0x0001
+
+#define NBD_EIO               5
+#define NBD_EINVAL            22
+#define NBD_ENOSPC            28
+
+#define NBD_MAX_REQUEST       (1024*1024)   // maximum read/write length of one request
+
+#define TRANS_FLAGS (NBD_FLAG_HAS_FLAGS | NBD_FLAG_SEND_FLUSH | NBD_FLAG_SEND_FUA | NBD_FLAG_SEND_TRIM)
+
+static volatile sig_atomic_t _stop;
+static uint64_t _size;
+static uint8_t* _buf;
+
+static void onSignal(int sig) {
+  (void)sig;
+  _stop = 1;
+}
+
+static bool readFull(int fd, void* p, size_t n) {
+  uint8_t* b = (uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = read(fd, b, n);
+    if (r < 0 && errno == EINTR && !_stop) continue;
+    if (r <= 0) return false;
+    b += r;
+    n -= r;
+  }
+  return true;
+}
+
+static bool writeFull(int fd, const void* p, size_t n) {
+  const uint8_t* b = (const uint8_t*)p;
+  while (n > 0) {
+    ssize_t r = write(fd, b, n);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    b += r;
+    n -= r;
+  }
+  return true;
+}
+
+static bool put16(int fd, uint16_t v) { v = htobe16(v); return writeFull(fd, &v, 2); }
+static bool put32(int fd, uint32_t v) { v = htobe32(v); return writeFull(fd, &v, 4); }
+static bool put64(int fd, uint64_t v) { v = htobe64(v); return writeFull(fd, &v, 8); }
+
+static bool optReply(int fd, uint32_t opt, uint32_t type, const void* data, uint32_t len) {
+  return put64(fd, NBD_OPT_REPLY_MAGIC) && put32(fd, opt) && put32(fd, type) &&
+         put32(fd, len) && (len == 0 || writeFull(fd, data, len));
+}
+
+//
+// NBD_REP_INFO 응답 (export 크기/flag, block size)
+//
+static bool sendInfo(int fd, uint32_t opt) {
+  uint8_t info[14];
+  uint16_t t16;
+  uint32_t t32;
+  uint64_t t64;
+
+  t16 = htobe16(NBD_INFO_EXPORT); memcpy(&info[0], &t16, 2);
+  t64 = htobe64(_size); memcpy(&info[2], &t64, 8);
+  t16 = htobe16(TRANS_FLAGS); memcpy(&info[10], &t16, 2);
+  if (!optReply(fd, opt, NBD_REP_INFO, info, 12)) return false;
+
+  // minimum 1 byte, preferred 4KB sector, maximum NBD_MAX_REQUEST
+  t16 = htobe16(NBD_INFO_BLOCK_SIZE); memcpy(&info[0], &t16, 2);
+  t32 = htobe32(1); memcpy(&info[2], &t32, 4);
+  t32 = htobe32(FLASHIO_SECTOR_SIZE); memcpy(&info[6], &t32, 4);
+  t32 = htobe32(NBD_MAX_REQUEST); memcpy(&info[10], &t32, 4);
+  return optReply(fd, opt, NBD_REP_INFO, info, 14);
+}
+
+//
+// handshake (fixed newstyle)
+// 반환값: true: transmission 단계로 진행, false: 연결 종료
+//
+static bool handshake(int fd) {
+  uint32_t cflags;
+  bool no_zeroes;
+
+  if (!put64(fd, NBDMAGIC) || !put64(fd, IHAVEOPT) ||
+      !put16(fd, NBD_FLAG_FIXED_NEWSTYLE | NBD_FLAG_NO_ZEROES)) return false;
+  if (!readFull(fd, &cflags, 4)) return false;
+  no_zeroes = (be32toh(cflags) & NBD_FLAG_C_NO_ZEROES) != 0;
+
+  for (;;) {
+    uint64_t magic;
+    uint32_t opt, len;
+    uint8_t data[1024];
+
+    if (!readFull(fd, &magic, 8) || !readFull(fd, &opt, 4) || !readFull(fd, &len, 4)) return false;
+    if (be64toh(magic) != IHAVEOPT) return false;
+    opt = be32toh(opt);
+    len = be32toh(len);
+    if (len > sizeof(data)) return false;
+    if (len && !readFull(fd, data, len)) return false;
+
+    switch (opt) {
+    case NBD_OPT_EXPORT_NAME: {
+      uint8_t zeroes[124];
+      memset(zeroes, 0, sizeof(zeroes));
+      return put64(fd, _size) && put16(fd, TRANS_FLAGS) &&
+             (no_zeroes || writeFull(fd, zeroes, sizeof(zeroes)));
+    }
+    case NBD_OPT_ABORT:
+      optReply(fd, opt, NBD_REP_ACK, NULL, 0);
+      return false;
+    case NBD_OPT_LIST: {
+      uint8_t rep[4 + sizeof(NBD_EXPORT) - 1];
+      uint32_t nlen = htobe32(sizeof(NBD_EXPORT) - 1);
+      memcpy(rep, &nlen, 4);
+      memcpy(&rep[4], NBD_EXPORT, sizeof(NBD_EXPORT) - 1);
+      if (!optReply(fd, opt, NBD_REP_SERVER, rep, sizeof(rep)) ||
+          !optReply(fd, opt, NBD_REP_ACK, NULL, 0)) return false;
+      break;
+    }
+    case NBD_OPT_INFO:
+    case NBD_OPT_GO:
+      if (!sendInfo(fd, opt) || !optReply(fd, opt, NBD_REP_ACK, NULL, 0)) return false;
+      if (opt == NBD_OPT_GO) return true;
+      break;
+    default:
+      if (!optReply(fd, opt, NBD_REP_ERR_UNSUP, NULL, 0)) return false;
+      break;
+    }
+  }
+}
+
+static bool reply(int fd, uint32_t err, uint64_t handle, const void* data, uint32_t len) {
+  uint8_t hdr[16];
+  uint32_t t32;
+  t32 = htobe32(NBD_SIMPLE_REPLY_MAGIC); memcpy(&hdr[0], &t32, 4);
+  t32 = htobe32(err); memcpy(&hdr[4], &t32, 4);
+  memcpy(&hdr[8], &handle, 8);      // handle is opaque, returned as received
+  return writeFull(fd, hdr, sizeof(hdr)) && (len == 0 || writeFull(fd, data, len));
+}
+
+//
+// 바뀔 섹터를 scrub baseline 에서 빼기 (추적 중이던 섹터가 있을 때만 저장, flash 에 쓰기 전에)
+//
+static void untrack(uint32_t addr, uint32_t len) {
+  if (SCRUB_invalidate(addr, len)) SCRUB_save(SCRUB_BASELINE);
+}
+
+//
+// transmission 단계: read/write/flush/trim 처리
+//
+static void serve(int fd) {
+  uint32_t rd = 0, wr = 0, tr = 0;
+
+  while (!_stop) {
+    uint8_t req[28];
+    uint32_t magic, len, err = 0;
+    uint16_t flags, type;
+    uint64_t handle, offset;
+
+    if (!readFull(fd, req, sizeof(req))) break;
+    memcpy(&magic, &req[0], 4);
+    memcpy(&flags, &req[4], 2);
+    memcpy(&type, &req[6], 2);
+    memcpy(&handle, &req[8], 8);
+    memcpy(&offset, &req[16], 8);
+    memcpy(&len, &req[24], 4);
+    if (be32toh(magic) != NBD_REQUEST_MAGIC) break;
+    flags = be16toh(flags);
+    type = be16toh(type);
+    offset = be64toh(offset);
+    len = be32toh(len);
+
+    if (type == NBD_CMD_DISC) break;
+    if ((type == NBD_CMD_READ || type == NBD_CMD_WRITE) && len > NBD_MAX_REQUEST) {
+      err = NBD_EINVAL;
+      if (type == NBD_CMD_WRITE) break;     // cannot skip payload safely
+    } else if (offset > _size || len > _size - offset) {     // offset + len 은 2^64 근처에서 넘칠 수 있음
+      err = NBD_ENOSPC;
+    }
+
+    switch (type) {
+    case NBD_CMD_READ:
+      if (err == 0 && !FLASHIO_read(offset, _buf, len)) err = NBD_EIO;
+      if (!reply(fd, err, handle, _buf, err ? 0 : len)) return;
+      rd += len;
+      break;
+    case NBD_CMD_WRITE:
+      if (!readFull(fd, _buf, len)) return;
+      if (err == 0) untrack(offset, len);
+      if (err == 0 && !FLASHIO_write(offset, _buf, len)) err = NBD_EIO;
+      if (err == 0 && (flags & NBD_CMD_FLAG_FUA) && !FLASHIO_flush()) err = NBD_EIO;
+      if (!reply(fd, err, handle, NULL, 0)) return;
+      wr += len;
+      break;
+    case NBD_CMD_FLUSH:
+      if (!FLASHIO_flush()) err = NBD_EIO;
+      if (!reply(fd, err, handle, NULL, 0)) return;
+      break;
+    case NBD_CMD_TRIM: {
+      // sector 경계 안쪽만 지운다 (trim 은 권고 사항이므로 나머지는 무시)
+      uint64_t s = (offset + FLASHIO_SECTOR_SIZE - 1) & ~(uint64_t)(FLASHIO_SECTOR_SIZE - 1);
+      uint64_t e = (offset + len) & ~(uint64_t)(FLASHIO_SECTOR_SIZE - 1);
+      if (err == 0 && e > s) {
+        untrack(s, e - s);
+        if (!FLASHIO_flush() || !FLASHIO_erase(s, e - s)) err = NBD_EIO;
+        tr += e - s;
+      }
+      if (!reply(fd, err, handle, NULL, 0)) return;
+      break;
+    }
+    default:
+      if (!reply(fd, NBD_EINVAL, handle, NULL, 0)) return;
+      break;
+    }
+  }
+  printf("read %u bytes, write %u bytes, trim %u bytes\n", rd, wr, tr);
+}
+
+//
+// Main program
+//    nbdflash [socket path]
+//
+int main(int argc, char* argv[]) {
+  const char* path = (argc > 1) ? argv[1] : NBD_SOCKET;
+  struct sockaddr_un sa;
+  struct sigaction act;
+  int lfd;
+
+  _buf = (uint8_t*)malloc(NBD_MAX_REQUEST);
+  if (_buf == NULL) return 1;
+
+  if (!BOARD_open(GPIO_CHIP)) return 1;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    BOARD_close();
+    return 1;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+
+  // Detect chip once to get the export size
+  BOARD_bypassEnable();
+  const struct flash_profile* chip = IS25LP256_detect();
+  BOARD_bypassDisable();
+  if (chip == NULL) {
+    printf("Unknown flash chip\n");
+    IS25LP256_end();
+    BOARD_close();
+    return 1;
+  }
+  _size = chip->size;
+  printf("Flash chip: %s, %u bytes\n", chip->name, chip->size);
+  SCRUB_load(SCRUB_BASELINE, chip->size);
+  if (!FLASHIO_open()) {
+    IS25LP256_end();
+    BOARD_close();
+    return 1;
+  }
+
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = onSignal;      // no SA_RESTART, so that accept()/read() return
+  sigaction(SIGINT, &act, NULL);
+  sigaction(SIGTERM, &act, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strncpy(sa.sun_path, path, sizeof(sa.sun_path) - 1);
+  unlink(path);
+  if (lfd < 0 || bind(lfd, (struct sockaddr*)&sa, sizeof(sa)) < 0 || listen(lfd, 1) < 0) {
+    perror("nbdflash socket");
+    IS25LP256_end();
+    BOARD_close();
+    return 1;
+  }
+  printf("Listening on %s\n", path);
+
+  while (!_stop) {
+    int fd = accept(lfd, NULL, NULL);
+    if (fd < 0) continue;
+
+    // FPGA is offline only while a client is connected
+    BOARD_bypassEnable();
+    FLASHIO_invalidate();
+    if (handshake(fd)) serve(fd);
+    if (!FLASHIO_flush()) printf("Write-back failed at disconnect, data written by the client is lost\n");
+    uint32_t ms = BOARD_bypassDisable();
+    printf("Client disconnected, FPGA offline %u ms\n", ms);
+    close(fd);
+  }
+
+  close(lfd);
+  unlink(path);
+  FLASHIO_close();
+  IS25LP256_end();
+  BOARD_close();
+  free(_buf);
+  return 0;
+}
@@ -0,0 +1,357 @@
+//
+// Binary patch update (*.patch), flasher side
+// Source blocks of the old image are read from flash (64KB read cache of flashio.c),
+// the new image is rebuilt in a 64KB buffer, checked against its block digest, and only sectors
+// which differ are erased and programmed.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "IS25LP256.h"
+#include "flashio.h"
+#include "sha256.h"
+#include "util.h"
+#include "patch.h"
+
+#define BLOCK_SIZE        PATCH_BLOCK_SIZE
+#define SECTORS_PER_BLOCK (BLOCK_SIZE / PATCH_SECTOR_SIZE)
+#define JOURNAL_MAGIC     "SPIFJNL1"
+
+// PATCH_JOURNAL header, followed by the block (len byte)
+struct journal_header {
+  char     magic[8];             // JOURNAL_MAGIC
+  uint8_t  new_sha256[32];       // patch of the block (new image digest)
+  uint32_t block;                // block number
+  uint32_t len;                  // bytes of block
+};
+
+static uint8_t _out[BLOCK_SIZE];     // new image being rebuilt
+static uint8_t _cur[BLOCK_SIZE];     // flash contents
+
+bool PATCH_isPatch(const char* path) {
+  char magic[8];
+  FILE* fp = fopen(path, "rb");
+  bool r;
+
+  if (fp == NULL) return false;
+  r = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, PATCH_MAGIC, 8) == 0;
+  fclose(fp);
+  return r;
+}
+
+//
+// 이미지 offset start 에서 시작하는 block 의 길이 (flash 의 64KB 경계까지, 마지막 block 은 섹터 단위 이미지 끝까지)
+//
+static uint32_t blockLen(const struct patch* p, uint32_t start) {
+  uint32_t padded = (p->hdr.new_size + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE * PATCH_SECTOR_SIZE;
+  uint32_t n = BLOCK_SIZE - (p->hdr.target_offset + start) % BLOCK_SIZE;
+  return (padded - start < n) ? padded - start : n;
+}
+
+//
+// block b 의 이미지 offset
+//
+static uint32_t blockStart(const struct patch* p, uint32_t b) {
+  uint32_t t = p->hdr.target_offset;
+  return (b == 0) ? 0 : (t / BLOCK_SIZE + b) * BLOCK_SIZE - t;
+}
+
+//
+// patch 열기
+// header 를 확인하고, 본문(block digest, op 와 literal data) 전체의 digest 를 확인한다. (flash 를 바꾸기 전에 손상 확인)
+// 반환값: true:정상 종료 false:실패
+//
+bool PATCH_open(const char* path, struct patch* p) {
+  struct sha256_ctx ctx;
+  uint8_t digest[SHA256_SIZE];
+  uint8_t buf[4096];
+  uint64_t padded;
+  uint32_t nblocks;
+  size_t n;
+
+  memset(p, 0, sizeof(*p));
+  p->fp = fopen(path, "rb");
+  if (p->fp == NULL) {
+    perror("Error opening patch");
+    return false;
+  }
+  if (fread(&p->hdr, 1, sizeof(p->hdr), p->fp) != sizeof(p->hdr) ||
+      memcmp(p->hdr.magic, PATCH_MAGIC, 8) != 0 || p->hdr.version != PATCH_VERSION ||
+      p->hdr.header_size != PATCH_HEADER_SIZE || p->hdr.target_offset % PATCH_SECTOR_SIZE != 0 ||
+      p->hdr.new_size == 0) {
+    printf("PATCH_open: invalid patch header\n");
+    PATCH_close(p);
+    return false;
+  }
+  padded = ((uint64_t)p->hdr.new_size + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE * PATCH_SECTOR_SIZE;
+  nblocks = (p->hdr.target_offset + padded - 1) / BLOCK_SIZE - p->hdr.target_offset / BLOCK_SIZE + 1;
+  if (p->hdr.target_offset + padded > 0x100000000ULL || p->hdr.nblocks != nblocks) {
+    printf("PATCH_open: invalid patch header\n");
+    PATCH_close(p);
+    return false;
+  }
+  p->blocks = (uint8_t*)malloc((size_t)nblocks * SHA256_SIZE);
+  if (p->blocks == NULL || fread(p->blocks, SHA256_SIZE, nblocks, p->fp) != nblocks) {
+    printf("PATCH_open: patch is truncated\n");
+    PATCH_close(p);
+    return false;
+  }
+
+  SHA256_init(&ctx);
+  SHA256_update(&ctx, p->blocks, (size_t)nblocks * SHA256_SIZE);
+  while ((n = fread(buf, 1, sizeof(buf), p->fp)) > 0) SHA256_update(&ctx, buf, n);
+  SHA256_final(&ctx, digest);
+  if (memcmp(digest, p->hdr.body_sha256, SHA256_SIZE) != 0) {
+    printf("PATCH_open: patch digest mismatch\n");
+    PATCH_close(p);
+    return false;
+  }
+  return true;
+}
+
+void PATCH_close(struct patch* p) {
+  if (p->fp) fclose(p->fp);
+  free(p->blocks);
+  memset(p, 0, sizeof(*p));
+}
+
+//
+// 지우기 전에 block 을 journal 에 저장 (fsync 까지). 실패하면 그 block 은 중간에 멈추면 이어 쓸 수 없다.
+//
+static bool journalSave(const struct patch* p, uint32_t b, uint32_t len) {
+  struct journal_header j;
+  FILE* fp;
+  bool ok;
+
+  if (!UTIL_stateDir() || (fp = fopen(PATCH_JOURNAL, "wb")) == NULL) return false;
+  memset(&j, 0, sizeof(j));
+  memcpy(j.magic, JOURNAL_MAGIC, 8);
+  memcpy(j.new_sha256, p->hdr.new_sha256, SHA256_SIZE);
+  j.block = b;
+  j.len = len;
+  ok = fwrite(&j, sizeof(j), 1, fp) == 1 && fwrite(_out, 1, len, fp) == len && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  return (fclose(fp) == 0) && ok;
+}
+
+//
+// journal 에서 block b 를 _out 으로 읽기 (같은 patch, 같은 block 이고 block digest 가 맞을 때만)
+//
+static bool journalLoad(const struct patch* p, uint32_t b, uint32_t len) {
+  struct journal_header j;
+  uint8_t digest[SHA256_SIZE];
+  FILE* fp = fopen(PATCH_JOURNAL, "rb");
+  bool ok;
+
+  if (fp == NULL) return false;
+  ok = fread(&j, sizeof(j), 1, fp) == 1 && memcmp(j.magic, JOURNAL_MAGIC, 8) == 0 &&
+       memcmp(j.new_sha256, p->hdr.new_sha256, SHA256_SIZE) == 0 && j.block == b && j.len == len &&
+       fread(_out, 1, len, fp) == len;
+  fclose(fp);
+  if (!ok) return false;
+  SHA256_digest(_out, len, digest);
+  return memcmp(digest, &p->blocks[b * SHA256_SIZE], SHA256_SIZE) == 0;
+}
+
+//
+// 다시 만든 block 을 flash 와 비교해서 바뀐 섹터만 지우고 쓰기
+// 16개 섹터가 모두 바뀐 64KB block 은 block 단위로 지운다.
+// written(in/out) : 쓴 섹터 수에 더함
+// 반환값: true:정상 종료 false:지우기 또는 쓰기 실패 (거기서 멈춘다)
+//
+static bool flushBlock(uint32_t addr, uint32_t len, uint32_t* written) {
+  uint16_t psize = IS25LP256_profile()->page_size;
+  bool changed[SECTORS_PER_BLOCK];
+  uint32_t s, pg, k, nsect = len / PATCH_SECTOR_SIZE, cnt = 0;
+
+  IS25LP256_fastread(addr, _cur, len);
+  for (s = 0; s < nsect; s++) {
+    changed[s] = memcmp(&_cur[s * PATCH_SECTOR_SIZE], &_out[s * PATCH_SECTOR_SIZE], PATCH_SECTOR_SIZE) != 0;
+    if (changed[s]) cnt++;
+  }
+  if (cnt == 0) return true;
+  FLASHIO_invalidate();      // read cache 에 남은 이전 내용 버림
+
+  if (cnt == SECTORS_PER_BLOCK && addr % BLOCK_SIZE == 0) {
+    if (!IS25LP256_erase64Block(addr / BLOCK_SIZE, true)) {
+      printf("PATCH_apply: erase failed at %08x\n", addr);
+      return false;
+    }
+  } else {
+    for (s = 0; s < nsect; s++) {
+      if (changed[s] && !IS25LP256_eraseSector((addr / PATCH_SECTOR_SIZE) + s, true)) {
+        printf("PATCH_apply: erase failed at %08x\n", addr + s * PATCH_SECTOR_SIZE);
+        return false;
+      }
+    }
+  }
+  for (s = 0; s < nsect; s++) {
+    if (!changed[s]) continue;
+    for (pg = s * PATCH_SECTOR_SIZE; pg < (s + 1) * PATCH_SECTOR_SIZE; pg += psize) {
+      for (k = 0; k < psize && _out[pg + k] == 0xFF; k++) ;
+      if (k < psize && IS25LP256_write(addr + pg, &_out[pg], psize) != psize) {
+        printf("PATCH_apply: program failed at %08x\n", addr + pg);
+        return false;
+      }
+    }
+  }
+  *written += cnt;
+  return true;
+}
+
+//
+// 새 이미지 다시 만들기 및 쓰기
+// op 를 순서대로 실행해서 64KB 버퍼를 채우고, 찰 때마다 block digest 를 확인하고 flash 에 반영한다.
+// p->resume 앞의 block 은 이미 새 이미지이므로 op 만 건너뛴다. (COPY 원본을 읽지 않음)
+// p->journal 이면 p->resume block 은 journal 에서 가져온다. (지우는 도중 멈춰서 자기 자신의 원본이 없음)
+// 자기 block 에서 COPY 하는 block 은 지우기 전에 journal 에 저장한다.
+// 마지막 섹터의 이미지 뒤쪽은 0xFF 로 채운다.
+// write(in) : false 이면 쓰지 않고 block digest 만 확인 (PATCH_check 에서 이어 쓰기 가능 여부 확인)
+//
+static bool applyOps(struct patch* p, uint32_t* written, bool write) {
+  uint8_t digest[SHA256_SIZE];
+  uint32_t t = p->hdr.target_offset;
+  uint32_t start = 0;        // image offset of _out[0]
+  uint32_t fill = 0;         // bytes in _out
+  uint32_t blk_len = blockLen(p, 0);
+  uint32_t b = 0;            // block number of _out
+  uint32_t cnt = 0;
+  uint32_t i;
+  bool self = false;         // block copies from its own old contents
+  bool nojournal = false;
+
+  if (fseek(p->fp, p->hdr.header_size + (long)p->hdr.nblocks * SHA256_SIZE, SEEK_SET) != 0) return false;
+  for (i = 0; i <= p->hdr.nops; i++) {
+    struct patch_op op;
+    uint32_t done = 0;
+
+    if (i == p->hdr.nops) {
+      // 마지막 block 의 이미지 뒤쪽 (0xFF)
+      if (start + fill != p->hdr.new_size) {
+        printf("PATCH_apply: ops make %u bytes, %u expected\n", start + fill, p->hdr.new_size);
+        return false;
+      }
+      if (fill == 0) break;
+      op.type = PATCH_FILL;
+      op.fill = 0xFF;
+      op.len = blk_len - fill;
+    } else if (fread(&op, 1, sizeof(op), p->fp) != sizeof(op) || start + fill + op.len > p->hdr.new_size ||
+               op.type < PATCH_COPY || op.type > PATCH_FILL ||
+               (op.type == PATCH_COPY && (uint64_t)op.src + op.len > p->hdr.old_size)) {
+      printf("PATCH_apply: invalid op %u\n", i);
+      return false;
+    }
+    while (done < op.len) {
+      uint32_t n = (op.len - done < blk_len - fill) ? op.len - done : blk_len - fill;
+      if (b < p->resume || (b == p->resume && p->journal)) {
+        if (op.type == PATCH_LITERAL && fseek(p->fp, n, SEEK_CUR) != 0) return false;
+      } else if (op.type == PATCH_COPY) {
+        if (!FLASHIO_read(t + op.src + done, &_out[fill], n)) return false;
+        if (op.src + done < start + blk_len && op.src + done + n > start) self = true;
+      } else if (op.type == PATCH_LITERAL) {
+        if (fread(&_out[fill], 1, n, p->fp) != n) {
+          printf("PATCH_apply: literal data is truncated\n");
+          return false;
+        }
+      } else {
+        memset(&_out[fill], op.fill, n);
+      }
+      done += n;
+      fill += n;
+      if (fill < blk_len) continue;
+
+      // block 완성: digest 확인 후 쓰기
+      if (b == p->resume && p->journal) {
+        if (!journalLoad(p, b, blk_len)) return false;
+      } else if (b >= p->resume) {
+        SHA256_digest(_out, blk_len, digest);
+        if (memcmp(digest, &p->blocks[b * SHA256_SIZE], SHA256_SIZE) != 0) {
+          if (write) printf("PATCH_apply: block at %08x does not rebuild to the new image, not written\n", t + start);
+          return false;
+        }
+      }
+      if (b >= p->resume && write) {
+        if (self && !nojournal && !journalSave(p, b, blk_len)) {
+          printf("PATCH_apply: cannot write %s, an interrupted apply may not be resumable\n", PATCH_JOURNAL);
+          nojournal = true;
+        }
+        if (!flushBlock(t + start, blk_len, &cnt)) return false;
+      }
+      self = false;
+      b++;
+      start += blk_len;
+      fill = 0;
+      if (b < p->hdr.nblocks) blk_len = blockLen(p, start);
+    }
+  }
+  if (write) unlink(PATCH_JOURNAL);
+  if (written) *written = cnt;
+  return true;
+}
+
+//
+// flash 의 이미지 영역을 한번 읽어서 old/new digest 와 block digest 를 동시에 계산
+// 둘 다 아니면 첫 불일치 block 부터 쓰지 않고 다시 만들어 본다. (중간에 멈춘 적용인지 확인)
+//
+int PATCH_check(struct patch* p) {
+  struct sha256_ctx old_ctx, new_ctx;
+  uint8_t old_digest[SHA256_SIZE], new_digest[SHA256_SIZE];
+  uint32_t padded = (p->hdr.new_size + PATCH_SECTOR_SIZE - 1) / PATCH_SECTOR_SIZE * PATCH_SECTOR_SIZE;
+  uint32_t size = (p->hdr.old_size > padded) ? p->hdr.old_size : padded;
+  uint32_t off, n, b = 0;
+  bool ok;
+
+  SHA256_init(&old_ctx);
+  SHA256_init(&new_ctx);
+  p->resume = p->hdr.nblocks;
+  for (off = 0; off < size; off += n) {
+    n = BLOCK_SIZE - (p->hdr.target_offset + off) % BLOCK_SIZE;     // block 경계 단위로 읽음
+    if (n > size - off) n = size - off;
+    IS25LP256_fastread(p->hdr.target_offset + off, _cur, n);
+    if (off < p->hdr.old_size) SHA256_update(&old_ctx, _cur, (p->hdr.old_size - off < n) ? p->hdr.old_size - off : n);
+    if (off < p->hdr.new_size) SHA256_update(&new_ctx, _cur, (p->hdr.new_size - off < n) ? p->hdr.new_size - off : n);
+    if (off < padded && p->resume == p->hdr.nblocks) {
+      SHA256_digest(_cur, blockLen(p, off), new_digest);
+      if (memcmp(new_digest, &p->blocks[b * SHA256_SIZE], SHA256_SIZE) != 0) p->resume = b;
+      b++;
+    }
+  }
+  SHA256_final(&old_ctx, old_digest);
+  SHA256_final(&new_ctx, new_digest);
+  if (memcmp(new_digest, p->hdr.new_sha256, SHA256_SIZE) == 0) return 1;
+  if (memcmp(old_digest, p->hdr.old_sha256, SHA256_SIZE) == 0) return 0;
+
+  if (p->resume == p->hdr.nblocks) return -1;
+  p->journal = journalLoad(p, p->resume, blockLen(p, blockStart(p, p->resume)));
+  if (!FLASHIO_open()) return -1;
+  ok = applyOps(p, NULL, false);
+  FLASHIO_close();
+  return ok ? 2 : -1;
+}
+
+bool PATCH_apply(struct patch* p, uint32_t* written) {
+  bool ok;
+
+  if (!FLASHIO_open()) return false;        // 이전 이미지 읽기용 cache
+  ok = applyOps(p, written, true);
+  FLASHIO_close();
+  return ok;
+}
+
+bool PATCH_verify(struct patch* p) {
+  struct sha256_ctx ctx;
+  uint8_t digest[SHA256_SIZE];
+  uint32_t off, n;
+
+  SHA256_init(&ctx);
+  for (off = 0; off < p->hdr.new_size; off += n) {
+    n = (p->hdr.new_size - off < BLOCK_SIZE) ? p->hdr.new_size - off : BLOCK_SIZE;
+    IS25LP256_fastread(p->hdr.target_offset + off, _cur, n);
+    SHA256_update(&ctx, _cur, n);
+  }
+  SHA256_final(&ctx, digest);
+  return memcmp(digest, p->hdr.new_sha256, SHA256_SIZE) == 0;
+}
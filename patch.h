@@ -0,0 +1,91 @@
+//
+// Binary patch update (*.patch)
+// Rebuilds the new image from the old image already in flash, so only the change is shipped.
+//
+// File layout (all integers little endian)
+//    struct patch_header                       (PATCH_HEADER_SIZE byte)
+//    SHA-256 of new image block        x nblocks    (32 byte each)
+//    struct patch_op [+ literal data]  x nops
+//
+// Ops produce the new image in order:
+//    PATCH_COPY     len bytes from the old image at src (read from flash)
+//    PATCH_LITERAL  len bytes following the op
+//    PATCH_FILL     len bytes of value fill
+// The new image is rebuilt and programmed one 64KB block at a time, only changed sectors are written.
+// Blocks are 64KB aligned in flash (the first and last ones may be shorter), the new image is padded
+// with 0xFF to its sector, and each block has its own digest.
+// A COPY never reads an old sector that is rewritten before the sector it is copied into (mkpatch keeps
+// this rule), so the patch can be applied in place.
+// An interrupted apply is resumed from the first block which does not match its digest. A block which
+// copies from itself is saved to PATCH_JOURNAL before it is erased, so it can be finished from there.
+//
+
+#define PATCH_MAGIC        "SPIFPAT1"
+#define PATCH_VERSION      2
+#define PATCH_BLOCK_SIZE   65536
+#define PATCH_JOURNAL      UTIL_STATE_DIR "/patch.journal"   // block being written (util.h)
+#define PATCH_HEADER_SIZE  160
+#define PATCH_SECTOR_SIZE  4096
+
+#define PATCH_COPY         1
+#define PATCH_LITERAL      2
+#define PATCH_FILL         3
+
+struct patch_header {
+  char     magic[8];             // PATCH_MAGIC
+  uint32_t version;              // PATCH_VERSION
+  uint32_t header_size;          // PATCH_HEADER_SIZE
+  uint32_t target_offset;        // flash address of old and new image (sector aligned)
+  uint32_t old_size;             // bytes of old image
+  uint32_t new_size;             // bytes of new image
+  uint32_t nops;                 // number of ops
+  uint8_t  jedec[3];             // expected JEDEC ID (00 00 00: any chip)
+  uint8_t  reserved0;
+  uint8_t  old_sha256[32];       // digest of old image (old_size byte), must be in flash
+  uint8_t  new_sha256[32];       // digest of new image (new_size byte)
+  uint8_t  body_sha256[32];      // digest of block digests, ops and literal data
+  uint32_t nblocks;              // number of blocks of the new image
+  uint8_t  reserved[24];
+};
+
+struct patch_op {
+  uint8_t  type;                 // PATCH_COPY, PATCH_LITERAL, PATCH_FILL
+  uint8_t  fill;                 // value of PATCH_FILL
+  uint16_t reserved;
+  uint32_t len;                  // bytes of new image produced
+  uint32_t src;                  // PATCH_COPY: offset in old image
+};
+
+// Patch opened by PATCH_open()
+struct patch {
+  FILE*               fp;
+  struct patch_header hdr;
+  uint8_t*            blocks;    // block digests (nblocks x 32 byte)
+  uint32_t            resume;    // first block to rebuild (set by PATCH_check)
+  bool                journal;   // block p->resume is taken from PATCH_JOURNAL (set by PATCH_check)
+};
+
+// Check if the file is a patch (by magic)
+bool PATCH_isPatch(const char* path);
+
+// Open patch and check header and body digest. Return: true:success false:failure
+bool PATCH_open(const char* path, struct patch* p);
+
+// Close patch
+void PATCH_close(struct patch* p);
+
+// Check flash contents by one read of the image area
+// If neither image is in flash, the blocks from the first one which does not match its digest are
+// rebuilt without writing, to check that an interrupted apply can be resumed.
+// Return: 1: new image is already in flash, 0: old image is in flash,
+//         2: partly applied (resumed from block p->resume), -1: none of these (patch cannot be applied)
+int PATCH_check(struct patch* p);
+
+// Rebuild new image from block p->resume and erase/program changed sectors.
+// Each block is checked against its digest before it is written.
+// written(out) : number of sectors written (NULL: not needed)
+// Return: true:success false:failure (stops at the first erase or program failure)
+bool PATCH_apply(struct patch* p, uint32_t* written);
+
+// Verify new image in flash by its digest. Return: true:success false:failure
+bool PATCH_verify(struct patch* p);
@@ -0,0 +1,315 @@
+//
+// Self-describing update package (*.pkg), flasher side
+// Plan, program and verify from the precomputed sector manifest
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "IS25LP256.h"
+#include "sha256.h"
+#include "pkg.h"
+
+#define SECTORS_PER_BLOCK 16    // 4KB sectors in 64KB block
+
+static uint8_t _unit[PKG_SECTOR_SIZE * SECTORS_PER_BLOCK];   // one erase unit (64KB block or sector)
+
+static bool isBlank(const uint8_t* p, uint32_t n) {
+  uint32_t i;
+  for (i = 0; i < n; i++) {
+    if (p[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+bool PKG_isPackage(const char* path) {
+  char magic[8];
+  FILE* fp = fopen(path, "rb");
+  bool r;
+
+  if (fp == NULL) return false;
+  r = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, PKG_MAGIC, 8) == 0;
+  fclose(fp);
+  return r;
+}
+
+//
+// 패키지 열기
+// header, sector table, range table 을 읽고 manifest digest 를 확인한다.
+// manifest digest 는 packer 가 계산한 것이므로 range 가 이미지 안에 있는지, payload 크기가 맞는지 따로 확인한다.
+// 반환값: true:정상 종료 false:실패
+//
+bool PKG_open(const char* path, struct pkg* p) {
+  struct sha256_ctx ctx;
+  struct pkg_header h;
+  uint8_t digest[SHA256_SIZE];
+  uint8_t blank[SHA256_SIZE];
+  uint64_t pos;
+  uint32_t r, s, end = 0;
+
+  memset(p, 0, sizeof(*p));
+  p->fp = fopen(path, "rb");
+  if (p->fp == NULL) {
+    perror("Error opening package");
+    return false;
+  }
+  if (fread(&p->hdr, 1, sizeof(p->hdr), p->fp) != sizeof(p->hdr) ||
+      memcmp(p->hdr.magic, PKG_MAGIC, 8) != 0 || p->hdr.version != PKG_VERSION ||
+      p->hdr.header_size != PKG_HEADER_SIZE || p->hdr.sector_size != PKG_SECTOR_SIZE ||
+      p->hdr.target_offset % PKG_SECTOR_SIZE != 0 || p->hdr.image_size == 0 ||
+      p->hdr.nsectors != ((uint64_t)p->hdr.image_size + PKG_SECTOR_SIZE - 1) / PKG_SECTOR_SIZE ||
+      (uint64_t)p->hdr.target_offset + (uint64_t)p->hdr.nsectors * PKG_SECTOR_SIZE > 0x100000000ULL ||
+      p->hdr.nranges > ((uint64_t)p->hdr.image_size + PKG_PAGE_SIZE - 1) / PKG_PAGE_SIZE ||
+      p->hdr.payload_offset != (uint64_t)PKG_HEADER_SIZE + (uint64_t)p->hdr.nsectors * sizeof(struct pkg_sector) +
+                               (uint64_t)p->hdr.nranges * sizeof(struct pkg_range)) {
+    printf("PKG_open: invalid package header\n");
+    PKG_close(p);
+    return false;
+  }
+
+  p->sectors = (struct pkg_sector*)malloc(sizeof(struct pkg_sector) * p->hdr.nsectors);
+  p->ranges = (struct pkg_range*)malloc(sizeof(struct pkg_range) * (p->hdr.nranges + 1));
+  p->range_pos = (uint32_t*)malloc(sizeof(uint32_t) * (p->hdr.nranges + 1));
+  if (p->sectors == NULL || p->ranges == NULL || p->range_pos == NULL ||
+      fread(p->sectors, sizeof(struct pkg_sector), p->hdr.nsectors, p->fp) != p->hdr.nsectors ||
+      fread(p->ranges, sizeof(struct pkg_range), p->hdr.nranges, p->fp) != p->hdr.nranges) {
+    printf("PKG_open: manifest is truncated\n");
+    PKG_close(p);
+    return false;
+  }
+
+  // manifest digest (header 의 manifest_sha256 는 0 으로 두고 계산)
+  h = p->hdr;
+  memset(h.manifest_sha256, 0, sizeof(h.manifest_sha256));
+  SHA256_init(&ctx);
+  SHA256_update(&ctx, &h, sizeof(h));
+  SHA256_update(&ctx, p->sectors, sizeof(struct pkg_sector) * p->hdr.nsectors);
+  SHA256_update(&ctx, p->ranges, sizeof(struct pkg_range) * p->hdr.nranges);
+  SHA256_final(&ctx, digest);
+  if (memcmp(digest, p->hdr.manifest_sha256, SHA256_SIZE) != 0) {
+    printf("PKG_open: manifest digest mismatch\n");
+    PKG_close(p);
+    return false;
+  }
+
+  // range: 주소 순서, 겹치지 않음, page 정렬, 이미지 안 (page 단위가 아닌 길이는 이미지 끝에서만), blank 섹터 밖
+  pos = p->hdr.payload_offset;
+  for (r = 0; r < p->hdr.nranges; r++) {
+    const struct pkg_range* rg = &p->ranges[r];
+    if (rg->length == 0 || rg->offset % PKG_PAGE_SIZE != 0 || rg->offset < end ||
+        (uint64_t)rg->offset + rg->length > p->hdr.image_size ||
+        (rg->length % PKG_PAGE_SIZE != 0 && rg->offset + rg->length != p->hdr.image_size)) {
+      printf("PKG_open: invalid range %u (%08x + %u)\n", r, rg->offset, rg->length);
+      PKG_close(p);
+      return false;
+    }
+    for (s = rg->offset / PKG_SECTOR_SIZE; s <= (rg->offset + rg->length - 1) / PKG_SECTOR_SIZE; s++) {
+      if (p->sectors[s].flags & PKG_SECTOR_BLANK) {
+        printf("PKG_open: range %u has data in blank sector %u\n", r, s);
+        PKG_close(p);
+        return false;
+      }
+    }
+    end = rg->offset + rg->length;
+    p->range_pos[r] = pos;
+    pos += rg->length;
+  }
+  if (fseek(p->fp, 0, SEEK_END) != 0 || ftell(p->fp) < 0 || (uint64_t)ftell(p->fp) < pos) {
+    printf("PKG_open: payload is truncated\n");
+    PKG_close(p);
+    return false;
+  }
+
+  // blank 섹터는 hash 대신 0xFF 검사를 하므로 hash 도 0xFF 섹터의 것이어야 한다
+  memset(_unit, 0xFF, PKG_SECTOR_SIZE);
+  SHA256_digest(_unit, PKG_SECTOR_SIZE, blank);
+  for (s = 0; s < p->hdr.nsectors; s++) {
+    if ((p->sectors[s].flags & PKG_SECTOR_BLANK) && memcmp(p->sectors[s].sha256, blank, SHA256_SIZE) != 0) {
+      printf("PKG_open: blank sector %u has a non-blank hash\n", s);
+      PKG_close(p);
+      return false;
+    }
+  }
+  return true;
+}
+
+void PKG_close(struct pkg* p) {
+  if (p->fp) fclose(p->fp);
+  free(p->sectors);
+  free(p->ranges);
+  free(p->range_pos);
+  memset(p, 0, sizeof(*p));
+}
+
+//
+// 변경할 섹터 찾기
+// flash 섹터를 읽어 hash 를 계산하고 manifest 의 hash 와 비교한다. (이미지 hash 는 계산하지 않음)
+// blank 섹터는 hash 없이 0xFF 인지만 본다.
+//
+uint32_t PKG_plan(struct pkg* p, uint8_t* changed) {
+  uint8_t buf[PKG_SECTOR_SIZE];
+  uint8_t digest[SHA256_SIZE];
+  uint32_t i, cnt = 0;
+
+  for (i = 0; i < p->hdr.nsectors; i++) {
+    IS25LP256_fastread(p->hdr.target_offset + i * PKG_SECTOR_SIZE, buf, PKG_SECTOR_SIZE);
+    if (p->sectors[i].flags & PKG_SECTOR_BLANK) changed[i] = !isBlank(buf, PKG_SECTOR_SIZE);
+    else {
+      SHA256_digest(buf, PKG_SECTOR_SIZE, digest);
+      changed[i] = memcmp(digest, p->sectors[i].sha256, SHA256_SIZE) != 0;
+    }
+    if (changed[i]) cnt++;
+  }
+  return cnt;
+}
+
+//
+// 이미지 섹터 s0 부터 n 개를 payload 에서 읽기 (range 밖은 0xFF)
+// range 는 PKG_open 에서 정렬과 범위를 확인했으므로 이분 탐색으로 첫 range 를 찾는다.
+// 반환값: true:정상 종료 false:payload 읽기 실패
+//
+static bool loadSectors(struct pkg* p, uint32_t s0, uint32_t n, uint8_t* buf) {
+  uint32_t start = s0 * PKG_SECTOR_SIZE, end = start + n * PKG_SECTOR_SIZE;
+  uint32_t lo = 0, hi = p->hdr.nranges, r, a, e;
+
+  memset(buf, 0xFF, n * PKG_SECTOR_SIZE);
+  while (lo < hi) {                        // start 뒤에서 끝나는 첫 range
+    r = (lo + hi) / 2;
+    if (p->ranges[r].offset + p->ranges[r].length <= start) lo = r + 1;
+    else hi = r;
+  }
+  for (r = lo; r < p->hdr.nranges && p->ranges[r].offset < end; r++) {
+    const struct pkg_range* rg = &p->ranges[r];
+    a = (rg->offset > start) ? rg->offset : start;
+    e = (rg->offset + rg->length < end) ? rg->offset + rg->length : end;
+    if (fseek(p->fp, (long)p->range_pos[r] + (a - rg->offset), SEEK_SET) != 0 ||
+        fread(&buf[a - start], 1, e - a, p->fp) != e - a) {
+      printf("PKG_program: payload is truncated\n");
+      return false;
+    }
+  }
+  return true;
+}
+
+//
+// 변경할 섹터 지우기 및 쓰기
+// 먼저 바뀔 섹터의 payload 를 모두 manifest hash 와 비교한다. (깨진 payload 로 섹터를 지우지 않음)
+// 그 다음 64KB block 의 16개 섹터가 모두 이미지 안에 있고 모두 변경 대상이면 block 단위로,
+// 아니면 섹터 단위로 지우고 바로 그 단위를 program 한다. 지우기나 쓰기에 실패하면 거기서 멈춘다.
+//
+bool PKG_program(struct pkg* p, const uint8_t* changed) {
+  uint32_t first = p->hdr.target_offset / PKG_SECTOR_SIZE;   // flash sector number of image sector 0
+  uint8_t digest[SHA256_SIZE];
+  uint32_t i, j, n, addr, pg;
+  bool ok;
+
+  for (i = 0; i < p->hdr.nsectors; i++) {
+    if (!changed[i] || (p->sectors[i].flags & PKG_SECTOR_BLANK)) continue;
+    if (!loadSectors(p, i, 1, _unit)) return false;
+    SHA256_digest(_unit, PKG_SECTOR_SIZE, digest);
+    if (memcmp(digest, p->sectors[i].sha256, SHA256_SIZE) != 0) {
+      printf("PKG_program: payload of sector %04x does not match the manifest, nothing erased\n", first + i);
+      return false;
+    }
+  }
+
+  for (i = 0; i < p->hdr.nsectors; i += n) {
+    n = 1;
+    if (!changed[i]) continue;
+    if ((first + i) % SECTORS_PER_BLOCK == 0 && i + SECTORS_PER_BLOCK <= p->hdr.nsectors) {
+      for (j = 0; j < SECTORS_PER_BLOCK && changed[i + j]; j++) ;
+      if (j == SECTORS_PER_BLOCK) n = SECTORS_PER_BLOCK;
+    }
+    if (!loadSectors(p, i, n, _unit)) return false;
+
+    addr = (first + i) * PKG_SECTOR_SIZE;
+    if (n == SECTORS_PER_BLOCK) ok = IS25LP256_erase64Block((first + i) / SECTORS_PER_BLOCK, true);
+    else ok = IS25LP256_eraseSector(first + i, true);
+    if (!ok) {
+      printf("PKG_program: erase failed at %08x\n", addr);
+      return false;
+    }
+    // blank 섹터와 0xFF page 는 지우기만 한다
+    for (pg = 0; pg < n * PKG_SECTOR_SIZE; pg += PKG_PAGE_SIZE) {
+      if (isBlank(&_unit[pg], PKG_PAGE_SIZE)) continue;
+      if (IS25LP256_write(addr + pg, &_unit[pg], PKG_PAGE_SIZE) != PKG_PAGE_SIZE) {
+        printf("PKG_program: program failed at %08x\n", addr + pg);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//
+// 검증: 섹터별 hash 와 전체 이미지 digest 비교
+//
+bool PKG_verify(struct pkg* p) {
+  struct sha256_ctx whole;
+  uint8_t buf[PKG_SECTOR_SIZE];
+  uint8_t digest[SHA256_SIZE];
+  uint32_t i, bad = 0;
+  bool ok;
+
+  SHA256_init(&whole);
+  for (i = 0; i < p->hdr.nsectors; i++) {
+    uint32_t len = p->hdr.image_size - i * PKG_SECTOR_SIZE;
+    if (len > PKG_SECTOR_SIZE) len = PKG_SECTOR_SIZE;
+    IS25LP256_fastread(p->hdr.target_offset + i * PKG_SECTOR_SIZE, buf, PKG_SECTOR_SIZE);
+    if (p->sectors[i].flags & PKG_SECTOR_BLANK) ok = isBlank(buf, PKG_SECTOR_SIZE);
+    else {
+      SHA256_digest(buf, PKG_SECTOR_SIZE, digest);
+      ok = memcmp(digest, p->sectors[i].sha256, SHA256_SIZE) == 0;
+    }
+    if (!ok) {
+      if (bad < 16) printf("Verify failed at sector %04x (%08x)\n", p->hdr.target_offset / PKG_SECTOR_SIZE + i, p->hdr.target_offset + i * PKG_SECTOR_SIZE);
+      bad++;
+    }
+    SHA256_update(&whole, buf, len);
+  }
+  SHA256_final(&whole, digest);
+  if (memcmp(digest, p->hdr.image_sha256, SHA256_SIZE) != 0) {
+    printf("Verify failed: image digest mismatch\n");
+    return false;
+  }
+  return bad == 0;
+}
+
+//
+// 패키지의 전체 이미지를 메모리로 읽기
+// 섹터 크기로 0xFF 채움, 이미지 digest 확인
+// 반환값: 이미지 (nsectors * 4096 byte, free() 로 해제), 실패시 NULL
+//
+uint8_t* PKG_loadImage(struct pkg* p) {
+  uint8_t digest[SHA256_SIZE];
+  uint8_t* image;
+  uint32_t r;
+
+  image = (uint8_t*)malloc((size_t)p->hdr.nsectors * PKG_SECTOR_SIZE);
+  if (image == NULL) return NULL;
+  memset(image, 0xFF, (size_t)p->hdr.nsectors * PKG_SECTOR_SIZE);
+
+  if (fseek(p->fp, p->hdr.payload_offset, SEEK_SET) != 0) {
+    free(image);
+    return NULL;
+  }
+  for (r = 0; r < p->hdr.nranges; r++) {
+    const struct pkg_range* rg = &p->ranges[r];
+    if (rg->offset + rg->length > p->hdr.image_size ||
+        fread(&image[rg->offset], 1, rg->length, p->fp) != rg->length) {
+      printf("PKG_loadImage: payload is truncated\n");
+      free(image);
+      return NULL;
+    }
+  }
+
+  SHA256_digest(image, p->hdr.image_size, digest);
+  if (memcmp(digest, p->hdr.image_sha256, SHA256_SIZE) != 0) {
+    printf("PKG_loadImage: image digest mismatch\n");
+    free(image);
+    return NULL;
+  }
+  return image;
+}
@@ -0,0 +1,83 @@
+//
+// Self-describing update package (*.pkg)
+//
+// File layout (all integers little endian)
+//    struct pkg_header                         (PKG_HEADER_SIZE byte)
+//    struct pkg_sector x nsectors             per-sector hash of the image (last sector padded with 0xFF)
+//    struct pkg_range  x nranges              non-blank ranges of the image (page aligned)
+//    payload                                   data of the ranges, in order
+//
+// The flasher plans (which sectors to erase/program) and verifies from the manifest,
+// hashes of the image are never recomputed on the CM4.
+//
+
+#define PKG_MAGIC        "SPIFPKG1"
+#define PKG_VERSION      1
+#define PKG_HEADER_SIZE  128
+#define PKG_SECTOR_SIZE  4096
+#define PKG_PAGE_SIZE    256
+
+#define PKG_SECTOR_BLANK 0x01    // sector is all 0xFF in the image (checked by scanning, not hashing)
+
+struct pkg_header {
+  char     magic[8];             // PKG_MAGIC
+  uint32_t version;              // PKG_VERSION
+  uint32_t header_size;          // PKG_HEADER_SIZE
+  uint32_t target_offset;        // flash address of the image (sector aligned)
+  uint32_t image_size;           // bytes of the image
+  uint32_t sector_size;          // PKG_SECTOR_SIZE
+  uint32_t nsectors;             // number of sectors covering the image
+  uint32_t nranges;              // number of payload ranges
+  uint32_t payload_offset;       // file offset of payload
+  uint8_t  jedec[3];             // expected JEDEC ID (00 00 00: any chip)
+  uint8_t  reserved0;
+  uint8_t  image_sha256[32];     // digest of whole image (image_size byte)
+  uint8_t  manifest_sha256[32];  // digest of header (this field zeroed) and tables
+  uint8_t  reserved[20];
+};
+
+struct pkg_sector {
+  uint8_t  sha256[32];           // digest of sector (4096 byte)
+  uint32_t flags;                // PKG_SECTOR_BLANK
+};
+
+struct pkg_range {
+  uint32_t offset;               // offset in image (page aligned)
+  uint32_t length;               // bytes (multiple of page size, except the end of image)
+};
+
+// Package opened by PKG_open()
+struct pkg {
+  FILE*              fp;
+  struct pkg_header  hdr;
+  struct pkg_sector* sectors;
+  struct pkg_range*  ranges;
+  uint32_t*          range_pos;  // file offset of the data of each range
+};
+
+// Check if the file is a package (by magic)
+bool PKG_isPackage(const char* path);
+
+// Open package, load its manifest and check it (digest, ranges inside the image, payload size)
+// Return: true:success false:failure
+bool PKG_open(const char* path, struct pkg* p);
+
+// Close package
+void PKG_close(struct pkg* p);
+
+// Compare flash with manifest sector hashes
+// changed(out) : 1 for sectors which have to be written (nsectors byte)
+// Return: number of changed sectors
+uint32_t PKG_plan(struct pkg* p, uint8_t* changed);
+
+// Erase and program changed sectors. Payload of all changed sectors is checked against the
+// manifest before the first erase, then each 64KB block or sector is erased and programmed in turn.
+// Return: true:success false:failure (stops at the first erase or program failure)
+bool PKG_program(struct pkg* p, const uint8_t* changed);
+
+// Verify flash by sector hashes and whole image digest. Return: true:success false:failure
+bool PKG_verify(struct pkg* p);
+
+// Load whole image into memory, padded with 0xFF to sector size, and check image digest
+// Return: image (free() after use), NULL on failure
+uint8_t* PKG_loadImage(struct pkg* p);
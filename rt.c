@@ -0,0 +1,113 @@
+//
+// Real-time execution of flash I/O and latency statistics
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "rt.h"
+
+static bool _enabled;
+static bool _locked, _pinned, _fifo;
+static cpu_set_t _old_cpus;
+static uint32_t _lat[RT_LAT_BUCKETS];      // histogram, 미리 할당 (측정 중에는 메모리 할당 없음)
+static uint32_t _lat_n, _lat_max;
+static bool _lat_rt;                       // samples are taken in real-time mode
+
+//
+// 스택을 미리 써서 page fault 가 측정 중에 나지 않게 한다 (mlockall 뒤에 호출)
+//
+static void prefaultStack(void) {
+  uint8_t stack[RT_STACK_SIZE];
+  memset(stack, 0, sizeof(stack));
+  __asm__ volatile("" : : "r"(stack) : "memory");     // memset 이 최적화로 없어지지 않게
+}
+
+bool RT_enable(int cpu, int prio) {
+  struct sched_param sp;
+  cpu_set_t cpus;
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    perror("RT_enable: mlockall");
+    return false;
+  }
+  _locked = true;
+  prefaultStack();
+
+  if (cpu >= 0) {
+    sched_getaffinity(0, sizeof(_old_cpus), &_old_cpus);
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+      perror("RT_enable: sched_setaffinity");
+      goto fail;
+    }
+    _pinned = true;
+  }
+
+  memset(&sp, 0, sizeof(sp));
+  sp.sched_priority = prio;
+  if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+    perror("RT_enable: sched_setscheduler");
+    goto fail;
+  }
+  _fifo = true;
+  _enabled = true;                    // 모두 설정된 뒤에만
+  printf("Real-time mode: SCHED_FIFO %d, cpu %d, memory locked\n", prio, cpu);
+  return true;
+
+fail:
+  RT_disable();                       // 일부만 된 설정 (mlock, affinity) 되돌림
+  return false;
+}
+
+void RT_disable(void) {
+  struct sched_param sp;
+
+  memset(&sp, 0, sizeof(sp));
+  if (_fifo) sched_setscheduler(0, SCHED_OTHER, &sp);
+  if (_pinned) sched_setaffinity(0, sizeof(_old_cpus), &_old_cpus);
+  if (_locked) munlockall();
+  _enabled = _locked = _pinned = _fifo = false;
+}
+
+bool RT_enabled(void) {
+  return _enabled;
+}
+
+void RT_latReset(void) {
+  memset(_lat, 0, sizeof(_lat));
+  _lat_n = _lat_max = 0;
+  _lat_rt = _enabled;
+}
+
+void RT_latAdd(uint32_t us) {
+  _lat[(us < RT_LAT_BUCKETS) ? us : RT_LAT_BUCKETS - 1]++;
+  _lat_n++;
+  if (us > _lat_max) _lat_max = us;
+}
+
+//
+// histogram 에서 백분위 값 (usec)
+//
+static uint32_t percentile(uint32_t pct) {
+  uint64_t rank = ((uint64_t)_lat_n * pct + 99) / 100;     // rank 번째 샘플 (1부터)
+  uint64_t sum = 0;
+  uint32_t i;
+
+  for (i = 0; i < RT_LAT_BUCKETS; i++) {
+    sum += _lat[i];
+    if (sum >= rank) return (i == RT_LAT_BUCKETS - 1) ? _lat_max : i;
+  }
+  return _lat_max;
+}
+
+void RT_latReport(const char* label) {
+  if (_lat_n == 0) return;
+  printf("%s (real-time %s): %u pages, p50 %u us, p99 %u us, max %u us\n",
+         label, _lat_rt ? "on" : "off", _lat_n, percentile(50), percentile(99), _lat_max);
+}
@@ -0,0 +1,31 @@
+//
+// Real-time execution of flash I/O (SCHED_FIFO, CPU pinning, locked memory)
+// and latency statistics of page programs
+//
+// Enabled by environment variable, for example FLASH_RT=3 (core 3, priority RT_PRIO)
+// or FLASH_RT=3,90. The core should be isolated from the scheduler (isolcpus=3 in cmdline.txt).
+//
+
+#define RT_ENV          "FLASH_RT"
+#define RT_PRIO         80          // SCHED_FIFO priority (1 - 99)
+#define RT_STACK_SIZE   (256 * 1024) // stack prefaulted by RT_enable()
+#define RT_LAT_BUCKETS  20000       // 1 usec buckets of latency histogram (longer ones go to the last bucket)
+
+// Lock all memory, prefault stack, pin to cpu (-1: no pinning) and switch to SCHED_FIFO prio
+// Return: true:success false:failure (partial settings are undone, process stays in normal mode)
+bool RT_enable(int cpu, int prio);
+
+// Back to SCHED_OTHER, previous CPU affinity and unlocked memory
+void RT_disable(void);
+
+// Real-time mode is enabled
+bool RT_enabled(void);
+
+// Clear latency histogram (samples from here are reported as taken with or without real-time mode)
+void RT_latReset(void);
+
+// Add one latency sample (usec)
+void RT_latAdd(uint32_t us);
+
+// Print count, p50, p99 and max of latency samples
+void RT_latReport(const char* label);
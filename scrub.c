@@ -0,0 +1,113 @@
+//
+// Sector CRC baseline for the flash scrubber
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "crc32.h"
+#include "scrub.h"
+#include "util.h"
+
+static struct scrub_entry* _table;
+static uint32_t _nsect;
+
+//
+// baseline 읽기 (파일이 없으면 빈 baseline)
+//
+bool SCRUB_load(const char* path, uint32_t chip_size) {
+  char magic[8];
+  uint32_t n;
+  FILE* fp;
+
+  free(_table);
+  _nsect = chip_size / SCRUB_SECTOR_SIZE;
+  _table = (struct scrub_entry*)calloc(_nsect, sizeof(struct scrub_entry));
+  if (_table == NULL) {
+    _nsect = 0;
+    return false;
+  }
+
+  fp = fopen(path, "rb");
+  if (fp == NULL) return true;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, SCRUB_MAGIC, 8) != 0 ||
+      fread(&n, sizeof(n), 1, fp) != 1 || n != _nsect ||
+      fread(_table, sizeof(struct scrub_entry), _nsect, fp) != _nsect) {
+    printf("SCRUB_load: %s is not a baseline of this chip, ignored\n", path);
+    memset(_table, 0, sizeof(struct scrub_entry) * _nsect);
+  }
+  fclose(fp);
+  return true;
+}
+
+//
+// baseline 저장 (임시 파일에 쓰고 rename, 도중에 끊겨도 이전 baseline 이 남는다)
+//
+bool SCRUB_save(const char* path) {
+  char tmp[512];
+  FILE* fp;
+
+  if (_table == NULL) return false;
+  if (strncmp(path, UTIL_STATE_DIR "/", strlen(UTIL_STATE_DIR) + 1) == 0 && !UTIL_stateDir()) return false;
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  fp = fopen(tmp, "wb");
+  if (fp == NULL) {
+    perror("SCRUB_save");
+    return false;
+  }
+  fwrite(SCRUB_MAGIC, 1, 8, fp);
+  fwrite(&_nsect, sizeof(_nsect), 1, fp);
+  fwrite(_table, sizeof(struct scrub_entry), _nsect, fp);
+  if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+    perror("SCRUB_save");
+    return false;
+  }
+  return true;
+}
+
+uint32_t SCRUB_crc(const uint8_t* sector) {
+  return CRC32_update(0, sector, SCRUB_SECTOR_SIZE);
+}
+
+void SCRUB_set(uint32_t addr, const uint8_t* data, uint32_t len) {
+  uint8_t buf[SCRUB_SECTOR_SIZE];
+  uint32_t off, n, s;
+
+  for (off = 0; off < len; off += SCRUB_SECTOR_SIZE) {
+    s = (addr + off) / SCRUB_SECTOR_SIZE;
+    if (_table == NULL || s >= _nsect) return;
+    n = (len - off < SCRUB_SECTOR_SIZE) ? len - off : SCRUB_SECTOR_SIZE;
+    memcpy(buf, &data[off], n);
+    memset(&buf[n], 0xFF, SCRUB_SECTOR_SIZE - n);
+    _table[s].crc = SCRUB_crc(buf);
+    _table[s].flags = SCRUB_VALID;
+  }
+}
+
+void SCRUB_adopt(uint32_t addr, uint32_t len) {
+  uint32_t s;
+  for (s = addr / SCRUB_SECTOR_SIZE; s < (addr + len + SCRUB_SECTOR_SIZE - 1) / SCRUB_SECTOR_SIZE; s++) {
+    if (_table == NULL || s >= _nsect) return;
+    _table[s].flags = SCRUB_ADOPT;
+  }
+}
+
+uint32_t SCRUB_invalidate(uint32_t addr, uint32_t len) {
+  uint32_t s, n = 0;
+  for (s = addr / SCRUB_SECTOR_SIZE; s < (addr + len + SCRUB_SECTOR_SIZE - 1) / SCRUB_SECTOR_SIZE; s++) {
+    if (_table == NULL || s >= _nsect) break;
+    if (_table[s].flags) n++;
+    _table[s].flags = 0;
+  }
+  return n;
+}
+
+uint32_t SCRUB_nsectors(void) {
+  return _nsect;
+}
+
+struct scrub_entry* SCRUB_entry(uint32_t sect_no) {
+  return (_table && sect_no < _nsect) ? &_table[sect_no] : NULL;
+}
@@ -0,0 +1,49 @@
+//
+// Sector CRC baseline for the flash scrubber (scrubflash)
+//
+// The baseline file keeps CRC-32 of every 4KB sector written by the flasher.
+// main.c records it while writing, scrubflash compares flash with it in small time slices.
+// Every tool that writes flash updates the baseline of the sectors it wrote, or drops them
+// (SCRUB_invalidate), and saves it before it releases the device, so the baseline never
+// describes older contents than flash.
+//
+// File layout (little endian)
+//    char     magic[8]          SCRUB_MAGIC
+//    uint32_t nsectors          sectors of the chip
+//    struct scrub_entry x nsectors
+//
+
+#define SCRUB_BASELINE     UTIL_STATE_DIR "/flash.crc"   // (util.h)
+#define SCRUB_MAGIC        "SPIFCRC1"
+#define SCRUB_SECTOR_SIZE  4096
+
+#define SCRUB_VALID        0x01     // crc is the baseline of the sector
+#define SCRUB_ADOPT        0x02     // sector was written and verified, take baseline from flash at next scrub
+
+struct scrub_entry {
+  uint32_t crc;
+  uint32_t flags;                   // SCRUB_VALID, SCRUB_ADOPT (0: not tracked)
+};
+
+// Load baseline (empty baseline if file does not exist). Return: true:success false:failure
+bool SCRUB_load(const char* path, uint32_t chip_size);
+
+// Save baseline (UTIL_STATE_DIR is created if needed). Return: true:success false:failure
+bool SCRUB_save(const char* path);
+
+// Set baseline of sectors from written data (addr: sector aligned, last sector padded with 0xFF)
+void SCRUB_set(uint32_t addr, const uint8_t* data, uint32_t len);
+
+// Mark sectors to take their baseline from flash at the next scrub (written without data in memory)
+void SCRUB_adopt(uint32_t addr, uint32_t len);
+
+// Stop tracking sectors (written with unknown contents, or not written to the end)
+// Return: number of sectors which were tracked
+uint32_t SCRUB_invalidate(uint32_t addr, uint32_t len);
+
+// Number of sectors, and entry of sector
+uint32_t SCRUB_nsectors(void);
+struct scrub_entry* SCRUB_entry(uint32_t sect_no);
+
+// CRC-32 of one sector
+uint32_t SCRUB_crc(const uint8_t* sector);
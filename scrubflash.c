@@ -0,0 +1,276 @@
+//
+// Background integrity scrubber of SPI Flash
+//
+//    sudo ./scrubflash [-b baseline] [-d duty%] [-s sectors] [-n passes] [-p pause_s] [-i image.bin [-o offset] [-r]]
+//    ./scrubflash -B -i image.bin [-o offset] [-z chip_size] [-b baseline]
+//    ex) sudo ./scrubflash -d 2 -n 0 -i SMI_v2.2_240613_1xSPI.bin -r
+//
+// Sectors with a CRC baseline (written by main, see scrub.h) are read a few at a time
+// and compared with the baseline. Each slice is one short SPI bypass window, and the pause
+// after a slice keeps the bus (FPGA offline) time under duty% of wall time.
+// GPIO and SPI are released between slices, so main/flashd/kvflash can run at any time;
+// when they hold the device the scrubber backs off. The tools update the baseline while they
+// hold the device, so it is loaded again in every slice and saved before the device is released.
+//
+// -i: known-good image, mismatching sectors are compared with it (flipped bits are counted)
+// -r: rewrite mismatching sectors from the image, only when the image sector matches the baseline
+// -B: build baseline from the image without touching flash (image already written by other tools)
+// Exit code 2: mismatching sectors are left in the last pass
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "IS25LP256.h"
+#include "board.h"
+#include "scrub.h"
+#include "util.h"
+
+#define PAGE_SIZE    256
+#define BACKOFF_US   1000000      // device is used by another tool
+#define MAX_SLICE    64           // sectors per slice
+#define CHIP_SIZE    0x2000000    // -B: IS25LP256 (32MB), -z for other chips
+
+static uint8_t _buf[MAX_SLICE * SCRUB_SECTOR_SIZE];
+static uint8_t* _image;
+static uint32_t _image_size, _image_offset;
+static uint32_t _chip_size = CHIP_SIZE;
+static const char* _baseline = SCRUB_BASELINE;
+
+// Counters of one pass
+static uint32_t _checked, _adopted, _bad, _rewritten;
+
+//
+// 이미지의 섹터 (이미지 뒤쪽은 0xFF)
+// 반환값: true: 섹터가 이미지 범위 안, false: 이미지 밖
+//
+static bool imageSector(uint32_t sect_no, uint8_t* out) {
+  uint32_t addr = sect_no * SCRUB_SECTOR_SIZE, off, n;
+
+  if (_image == NULL || addr < _image_offset || addr >= _image_offset + _image_size) return false;
+  off = addr - _image_offset;
+  n = (_image_size - off < SCRUB_SECTOR_SIZE) ? _image_size - off : SCRUB_SECTOR_SIZE;
+  memcpy(out, &_image[off], n);
+  memset(&out[n], 0xFF, SCRUB_SECTOR_SIZE - n);
+  return true;
+}
+
+//
+// 섹터 다시 쓰기 (erase, 0xFF 가 아닌 page 만 program, verify)
+//
+static bool rewriteSector(uint32_t sect_no, const uint8_t* data) {
+  uint8_t buf[SCRUB_SECTOR_SIZE];
+  uint32_t addr = sect_no * SCRUB_SECTOR_SIZE, pg, k;
+
+  IS25LP256_eraseSector(sect_no, true);
+  for (pg = 0; pg < SCRUB_SECTOR_SIZE; pg += PAGE_SIZE) {
+    for (k = 0; k < PAGE_SIZE && data[pg + k] == 0xFF; k++) ;
+    if (k < PAGE_SIZE) IS25LP256_write(addr + pg, &data[pg], PAGE_SIZE);
+  }
+  IS25LP256_fastread(addr, buf, SCRUB_SECTOR_SIZE);
+  return memcmp(buf, data, SCRUB_SECTOR_SIZE) == 0;
+}
+
+//
+// 한 섹터 검사 및 보고
+//
+static void checkSector(uint32_t sect_no, const uint8_t* data, bool rewrite) {
+  struct scrub_entry* e = SCRUB_entry(sect_no);
+  uint8_t good[SCRUB_SECTOR_SIZE];
+  uint32_t crc = SCRUB_crc(data);
+  uint32_t k, flips = 0;
+  bool have_image;
+
+  if (e->flags == 0) return;        // 이 slice 를 고른 뒤 다른 도구가 썼음
+  if (e->flags & SCRUB_ADOPT) {
+    // 쓰고 검증까지 끝난 섹터, 지금 내용을 baseline 으로
+    e->crc = crc;
+    e->flags = SCRUB_VALID;
+    _adopted++;
+    return;
+  }
+  _checked++;
+  if (crc == e->crc) return;
+
+  _bad++;
+  have_image = imageSector(sect_no, good);
+  if (have_image) {
+    for (k = 0; k < SCRUB_SECTOR_SIZE; k++) flips += __builtin_popcount(data[k] ^ good[k]);
+    printf("Sector %u (%08x): CRC %08x, expected %08x, %u bits differ from image\n",
+           sect_no, sect_no * SCRUB_SECTOR_SIZE, crc, e->crc, flips);
+  } else {
+    printf("Sector %u (%08x): CRC %08x, expected %08x\n", sect_no, sect_no * SCRUB_SECTOR_SIZE, crc, e->crc);
+  }
+  if (!rewrite) return;
+  if (!have_image || SCRUB_crc(good) != e->crc) {
+    printf("  not rewritten: image does not match the baseline of this sector\n");
+    return;
+  }
+  if (rewriteSector(sect_no, good)) {
+    printf("  rewritten from image\n");
+    _rewritten++;
+  } else {
+    printf("  rewrite failed\n");
+  }
+}
+
+//
+// 다음 slice 의 섹터를 골라서 한 bypass window 안에서 읽기 및 검사
+// next(in/out) : 다음에 볼 섹터 번호
+// 반환값: 검사한 섹터 수, -1: 장치를 다른 도구가 사용 중
+//
+static int scrubSlice(uint32_t* next, uint32_t max, bool rewrite) {
+  uint32_t first[MAX_SLICE], cnt[MAX_SLICE];
+  uint32_t nrun = 0, total = 0, s, r, k;
+  uint32_t done = _adopted + _rewritten;
+  const struct flash_profile* chip;
+
+  // 읽을 섹터를 연속 구간으로 모은다 (baseline 이 없는 섹터는 건너뜀)
+  for (s = *next; s < SCRUB_nsectors() && total < max; s++) {
+    if (SCRUB_entry(s)->flags == 0) continue;
+    if (nrun > 0 && first[nrun - 1] + cnt[nrun - 1] == s) cnt[nrun - 1]++;
+    else {
+      first[nrun] = s;
+      cnt[nrun++] = 1;
+    }
+    total++;
+  }
+  if (total == 0) {
+    *next = s;
+    return 0;
+  }
+
+  if (!BOARD_open(GPIO_CHIP)) return -1;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    BOARD_close();
+    return -1;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+  BOARD_bypassEnable();
+  chip = IS25LP256_profile();
+  // 장치를 잡은 동안은 baseline 을 바꾸는 도구가 없다, 그 사이에 바뀐 baseline 을 다시 읽는다
+  if (!SCRUB_load(_baseline, _chip_size)) chip = NULL;
+  for (r = 0; r < nrun && chip; r++) {
+    IS25LP256_fastread(first[r] * SCRUB_SECTOR_SIZE, _buf, cnt[r] * SCRUB_SECTOR_SIZE);
+    for (k = 0; k < cnt[r]; k++) checkSector(first[r] + k, &_buf[k * SCRUB_SECTOR_SIZE], rewrite);
+  }
+  if (_adopted + _rewritten != done) SCRUB_save(_baseline);
+  BOARD_bypassDisable();
+  IS25LP256_end();
+  BOARD_close();
+  *next = s;
+  return total;
+}
+
+//
+// 칩 확인 (짧은 bypass window)
+//
+static bool detectChip(void) {
+  const struct flash_profile* chip;
+
+  if (!BOARD_open(GPIO_CHIP)) return false;
+  if (!IS25LP256_begin(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) {
+    printf("SPISetup failed:\n");
+    BOARD_close();
+    return false;
+  }
+  IS25LP256_setClock(SPI_CMD_HZ, SPI_DATA_HZ);
+  BOARD_bypassEnable();
+  chip = IS25LP256_detect();
+  BOARD_bypassDisable();
+  IS25LP256_end();
+  BOARD_close();
+  if (chip == NULL) {
+    printf("Unknown flash chip\n");
+    return false;
+  }
+  printf("Flash chip: %s, %u bytes\n", chip->name, chip->size);
+  _chip_size = chip->size;
+  return true;
+}
+
+static void usage(void) {
+  printf("usage: scrubflash [-b baseline] [-d duty%%] [-s sectors] [-n passes] [-p pause_s] [-i image.bin [-o offset] [-r]]\n");
+  printf("       scrubflash -B -i image.bin [-o offset] [-z chip_size] [-b baseline]\n");
+}
+
+//
+// Main program
+//
+int main(int argc, char* argv[]) {
+  const char* image_path = NULL;
+  uint32_t duty = 5;              // % of wall time with SPI bypass (FPGA offline)
+  uint32_t slice = 16;            // sectors per slice
+  uint32_t passes = 1;            // 0: forever
+  uint32_t pause_s = 60;          // between passes
+  bool rewrite = false, build = false;
+  struct timespec t0, tp;
+  uint32_t pass, next, us, busy_us;
+  int opt, n;
+  int rc = 0;
+
+  while ((opt = getopt(argc, argv, "b:d:s:n:p:i:o:z:rB")) != -1) {
+    switch (opt) {
+    case 'b': _baseline = optarg; break;
+    case 'd': duty = strtoul(optarg, NULL, 0); break;
+    case 's': slice = strtoul(optarg, NULL, 0); break;
+    case 'n': passes = strtoul(optarg, NULL, 0); break;
+    case 'p': pause_s = strtoul(optarg, NULL, 0); break;
+    case 'i': image_path = optarg; break;
+    case 'o': _image_offset = strtoul(optarg, NULL, 0); break;
+    case 'z': _chip_size = strtoul(optarg, NULL, 0); break;
+    case 'r': rewrite = true; break;
+    case 'B': build = true; break;
+    default: usage(); return 1;
+    }
+  }
+  if (duty < 1 || duty > 100 || slice < 1 || slice > MAX_SLICE || _image_offset % SCRUB_SECTOR_SIZE ||
+      ((rewrite || build) && image_path == NULL)) {
+    usage();
+    return 1;
+  }
+  if (image_path && (_image = UTIL_readFile(image_path, &_image_size)) == NULL) return 1;
+
+  if (build) {
+    // 이미 써진 이미지의 baseline 만 만든다 (flash 는 건드리지 않음)
+    if (!SCRUB_load(_baseline, _chip_size)) return 1;
+    SCRUB_set(_image_offset, _image, _image_size);
+    if (!SCRUB_save(_baseline)) return 1;
+    printf("Baseline of %u sectors at %08x saved to %s\n",
+           (_image_size + SCRUB_SECTOR_SIZE - 1) / SCRUB_SECTOR_SIZE, _image_offset, _baseline);
+    free(_image);
+    return 0;
+  }
+
+  if (!detectChip() || !SCRUB_load(_baseline, _chip_size)) return 1;
+  printf("Scrub %s: %u sectors per slice, bus time %u%%\n", _baseline, slice, duty);
+
+  for (pass = 1; passes == 0 || pass <= passes; pass++) {
+    _checked = _adopted = _bad = _rewritten = 0;
+    busy_us = 0;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    for (next = 0; next < SCRUB_nsectors(); ) {
+      clock_gettime(CLOCK_MONOTONIC, &t0);
+      n = scrubSlice(&next, slice, rewrite);
+      if (n < 0) {
+        usleep(BACKOFF_US);        // 다른 도구가 장치를 사용 중, 나중에 다시
+        continue;
+      }
+      us = UTIL_elapsedUs(&t0);
+      busy_us += us;
+      // slice 시간이 전체의 duty% 가 되도록 쉰다
+      if (n > 0 && duty < 100) usleep((uint64_t)us * (100 - duty) / duty);
+    }
+    printf("Pass %u: %u sectors checked, %u mismatch, %u rewritten, %u adopted, bus %u ms of %u ms\n",
+           pass, _checked, _bad, _rewritten, _adopted, busy_us / 1000, UTIL_elapsedUs(&tp) / 1000);
+    rc = (_bad > _rewritten) ? 2 : 0;
+    if (passes != 0 && pass == passes) break;
+    sleep(pause_s);
+  }
+  free(_image);
+  return rc;
+}
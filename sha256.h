@@ -0,0 +1,18 @@
+//
+// SHA-256 (FIPS 180-4)
+//
+
+#define SHA256_SIZE 32
+
+struct sha256_ctx {
+  uint32_t state[8];
+  uint64_t count;          // total bytes
+  uint8_t  buf[64];
+};
+
+void SHA256_init(struct sha256_ctx* ctx);
+void SHA256_update(struct sha256_ctx* ctx, const void* data, size_t len);
+void SHA256_final(struct sha256_ctx* ctx, uint8_t* digest);
+
+// One-shot digest of data
+void SHA256_digest(const void* data, size_t len, uint8_t* digest);
@@ -0,0 +1,148 @@
+//
+// Linux /dev/spidev access for RaspberryPi
+// Direct ioctl(SPI_IOC_MESSAGE) backend, replaces wiringPiSPI
+//
+// wiringPiSPIDataRW() does one transfer per call, overwrites TX buffer with RX data
+// and fixes delay and bits-per-word. This backend keeps the fd open, sets mode and
+// speed only once, and uses separate tx_buf/rx_buf and per-transfer speed_hz.
+//
+// If the environment variable SPI_TRACE names a file, every transfer is recorded (trace.c).
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <linux/spi/spidev.h>
+#include "spidev.h"
+#include "trace.h"
+
+#define SPIDEV_BUFSIZ_PARAM   "/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DEFAULT 4096    // spidev default, maximum bytes of one message
+
+static int _fd = -1;
+static uint32_t _speed_hz;
+static uint32_t _bufsiz = SPIDEV_BUFSIZ_DEFAULT;
+static bool _trace;             // SPI_TRACE 가 지정되면 모든 전송을 기록
+
+//
+// spidev 'bufsiz' module parameter 읽기
+// 한번의 SPI_IOC_MESSAGE 에 들어가는 전체 byte 수의 최대값
+//
+static uint32_t readBufsiz(void) {
+  FILE* fp = fopen(SPIDEV_BUFSIZ_PARAM, "r");
+  unsigned long v = 0;
+  if (fp == NULL) return SPIDEV_BUFSIZ_DEFAULT;
+  if (fscanf(fp, "%lu", &v) != 1 || v == 0) v = SPIDEV_BUFSIZ_DEFAULT;
+  fclose(fp);
+  return (uint32_t)v;
+}
+
+//
+// spidev 열기
+// dev(in) : device 이름 (ex. /dev/spidev0.0)
+// mode(in) : SPI mode 0 ~ 3
+// speed_hz(in) : 기본 clock 속도
+// 반환값: true:정상 종료 false:실패
+//
+bool SPIDEV_open(const char* dev, uint8_t mode, uint32_t speed_hz) {
+  uint8_t bits = 8;
+
+  if (_fd >= 0) SPIDEV_close();
+
+  _fd = open(dev, O_RDWR);
+  if (_fd < 0) {
+    perror("SPIDEV_open");
+    return false;
+  }
+  // 다른 process (main, flashd 등)가 같은 device 를 사용 중이면 실패 (전송이 섞이지 않도록)
+  if (flock(_fd, LOCK_EX | LOCK_NB) < 0) {
+    printf("SPIDEV_open: %s is used by another process\n", dev);
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+  if (ioctl(_fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+      ioctl(_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+      ioctl(_fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+    perror("SPIDEV_open ioctl");
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+  _speed_hz = speed_hz;
+  _bufsiz = readBufsiz();
+  if (getenv("SPI_TRACE")) _trace = TRACE_open(getenv("SPI_TRACE"));
+  return true;
+}
+
+//
+// spidev 닫기
+//
+void SPIDEV_close(void) {
+  if (_fd >= 0) close(_fd);
+  _fd = -1;
+  if (_trace) TRACE_close();
+  _trace = false;
+}
+
+uint32_t SPIDEV_maxTransfer(void) {
+  return _bufsiz;
+}
+
+//
+// 1회 전송 (full-duplex)
+//
+int SPIDEV_transfer(const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t speed_hz) {
+  struct spi_ioc_transfer xfer;
+
+  memset(&xfer, 0, sizeof(xfer));
+  xfer.tx_buf = (unsigned long)tx;
+  xfer.rx_buf = (unsigned long)rx;
+  xfer.len = n;
+  xfer.speed_hz = speed_hz ? speed_hz : _speed_hz;
+  xfer.bits_per_word = 8;
+
+  if (_trace) TRACE_begin(NULL, 0, tx, n);
+  if (ioctl(_fd, SPI_IOC_MESSAGE(1), &xfer) < 0) {
+    perror("SPIDEV_transfer");
+    if (_trace) TRACE_end(NULL, 0, speed_hz, false);
+    return -1;
+  }
+  if (_trace) TRACE_end(rx, 0, speed_hz, true);
+  return (int)n;
+}
+
+//
+// 명령 전송 + 데이터 전송 (CS 유지)
+// 명령/주소는 작은 버퍼, 데이터는 호출자의 버퍼를 그대로 사용하므로 malloc/memcpy 가 필요 없다.
+//
+int SPIDEV_transfer2(const uint8_t* cmd, uint32_t ncmd, uint32_t cmd_hz,
+                     const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t data_hz) {
+  struct spi_ioc_transfer xfer[2];
+
+  memset(xfer, 0, sizeof(xfer));
+  xfer[0].tx_buf = (unsigned long)cmd;
+  xfer[0].len = ncmd;
+  xfer[0].speed_hz = cmd_hz ? cmd_hz : _speed_hz;
+  xfer[0].bits_per_word = 8;
+  xfer[1].tx_buf = (unsigned long)tx;
+  xfer[1].rx_buf = (unsigned long)rx;
+  xfer[1].len = n;
+  xfer[1].speed_hz = data_hz ? data_hz : _speed_hz;
+  xfer[1].bits_per_word = 8;
+
+  if (_trace) TRACE_begin(cmd, ncmd, tx, n);
+  if (ioctl(_fd, SPI_IOC_MESSAGE(n ? 2 : 1), xfer) < 0) {
+    perror("SPIDEV_transfer2");
+    if (_trace) TRACE_end(NULL, cmd_hz, data_hz, false);
+    return -1;
+  }
+  if (_trace) TRACE_end(rx, cmd_hz, data_hz, true);
+  return (int)(ncmd + n);
+}
@@ -0,0 +1,28 @@
+//
+// Linux /dev/spidev access for RaspberryPi
+// Direct ioctl(SPI_IOC_MESSAGE) backend, replaces wiringPiSPI
+//
+
+// Open spidev device (ex. "/dev/spidev0.0") and set mode, bits-per-word and default speed once.
+// The file descriptor is kept open and exclusively locked (flock) until SPIDEV_close().
+bool SPIDEV_open(const char* dev, uint8_t mode, uint32_t speed_hz);
+
+// Close spidev device
+void SPIDEV_close(void);
+
+// Maximum number of bytes in one SPI message (spidev 'bufsiz' module parameter)
+uint32_t SPIDEV_maxTransfer(void);
+
+// One full-duplex transfer with separate TX/RX buffers.
+// tx or rx can be NULL (NULL tx sends zeros, NULL rx discards received data).
+// speed_hz 0 means default speed given at SPIDEV_open().
+// Return: number of bytes transferred, -1 on error
+int SPIDEV_transfer(const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t speed_hz);
+
+// Command phase followed by data phase in one message (CS is kept low between them).
+// cmd(in)  : command, address and dummy bytes (received data is discarded)
+// tx(in)   : data to send in data phase, NULL for read
+// rx(out)  : received data in data phase, NULL for write
+// Return: number of bytes transferred (ncmd + n), -1 on error
+int SPIDEV_transfer2(const uint8_t* cmd, uint32_t ncmd, uint32_t cmd_hz,
+                     const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t data_hz);
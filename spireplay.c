@@ -0,0 +1,344 @@
+//
+// Replay and compare SPI transaction traces (*.trc, recorded with SPI_TRACE=file)
+//
+//    ./spireplay -s a.trc                  summary of a trace (no device)
+//    ./spireplay -c a.trc b.trc            compare two traces (A/B test of driver changes)
+//    sudo ./spireplay [-f] a.trc           replay on real hardware and compare timing and RX data
+//    ./spireplay-sim a.trc                 replay on the simulated flash (spisim.c)
+//
+// Transfers are replayed back to back. A run of status reads after a program or erase
+// (busy wait of the driver) is replayed as polling until WIP is cleared, so busy times of
+// the device can be compared. RX data is compared by hash (status reads are not compared).
+// Bus time of merged status polls is their whole span, including the time between them.
+// Replay on hardware modifies the flash like the recorded run did, -f is needed if the trace
+// contains program or erase.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "spidev.h"
+#include "board.h"
+#include "trace.h"
+#include "util.h"
+
+#define BUSY_TIMEOUT_US 120000000      // chip erase of 32MB takes up to about 2 minutes
+#define MAX_MISMATCH    10             // number of RX mismatches to be shown
+
+enum { C_READ, C_PROGRAM, C_ERASE4K, C_ERASE32K, C_ERASE64K, C_ERASECHIP, C_STATUS, C_OTHER, NCLASS };
+static const char* _cls_name[NCLASS] = { "read", "program", "erase 4K", "erase 32K", "erase 64K", "erase chip", "status", "other" };
+
+struct op {
+  struct trace_rec r;
+  uint8_t* tx;                   // tx payload (TRACE_TX)
+};
+
+struct cls_stat {
+  uint32_t count;
+  uint64_t bytes;
+  uint64_t bus_us;               // sum of transfer time
+  uint32_t nbusy;                // number of busy waits after the command
+  uint64_t busy_us;
+  uint32_t busy_max_us;
+};
+
+struct summary {
+  struct cls_stat c[NCLASS];
+  uint64_t wall_us;
+  uint32_t mismatches;
+};
+
+static uint8_t _buf[65536];
+
+static uint8_t opcode(const struct op* o) {
+  return o->r.cmd[0];
+}
+
+static int classify(const struct op* o) {
+  switch (opcode(o)) {
+  case 0x03: case 0x0B: case 0x13: case 0x0C: return C_READ;
+  case 0x02: case 0x12: return C_PROGRAM;
+  case 0x20: case 0x21: return C_ERASE4K;
+  case 0x52: case 0x5C: return C_ERASE32K;
+  case 0xD8: case 0xDC: return C_ERASE64K;
+  case 0xC7: case 0x60: return C_ERASECHIP;
+  case 0x05: return C_STATUS;
+  default: return C_OTHER;
+  }
+}
+
+static bool isBusyCmd(int c) {
+  return c == C_PROGRAM || c == C_ERASE4K || c == C_ERASE32K || c == C_ERASE64K || c == C_ERASECHIP;
+}
+
+// Flash address of command (4-byte address opcodes, otherwise 3-byte)
+static uint32_t address(const struct op* o) {
+  uint8_t op = opcode(o);
+  uint8_t ab = (op == 0x13 || op == 0x0C || op == 0x12 || op == 0x21 || op == 0x5C || op == 0xDC) ? 4 : 3;
+  uint32_t a = 0;
+  uint8_t i;
+  for (i = 1; i <= ab; i++) a = (a << 8) | o->r.cmd[i];
+  return a;
+}
+
+//
+// trace 파일 읽기
+// 반환값: 전송 수, -1: 실패
+//
+static int loadTrace(const char* path, struct op** ops) {
+  struct trace_header hdr;
+  struct op* v = NULL;
+  int n = 0, cap = 0;
+  FILE* fp = fopen(path, "rb");
+
+  if (fp == NULL) {
+    perror(path);
+    return -1;
+  }
+  if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+      hdr.version != TRACE_VERSION || hdr.rec_size != sizeof(struct trace_rec)) {
+    printf("%s: not a trace file\n", path);
+    fclose(fp);
+    return -1;
+  }
+  for (;;) {
+    if (n == cap) {
+      struct op* nv;
+      cap = cap ? cap * 2 : 4096;
+      nv = (struct op*)realloc(v, cap * sizeof(*v));
+      if (nv == NULL) break;
+      v = nv;
+    }
+    if (fread(&v[n].r, sizeof(v[n].r), 1, fp) != 1) break;
+    v[n].tx = NULL;
+    if (v[n].r.flags & TRACE_TX) {
+      v[n].tx = (uint8_t*)malloc(v[n].r.len);
+      if (v[n].tx == NULL || fread(v[n].tx, 1, v[n].r.len, fp) != v[n].r.len) {
+        free(v[n].tx);
+        break;
+      }
+    }
+    n++;
+  }
+  fclose(fp);
+  *ops = v;
+  return n;
+}
+
+static void freeTrace(struct op* ops, int n) {
+  int i;
+  for (i = 0; i < n; i++) free(ops[i].tx);
+  free(ops);
+}
+
+//
+// 기록된 시간으로 요약
+// busy 시간: program/erase 명령 끝에서 뒤따르는 status read 들의 끝까지
+//
+static void summarize(const struct op* ops, int n, struct summary* s) {
+  int i, j;
+
+  memset(s, 0, sizeof(*s));
+  for (i = 0; i < n; i++) {
+    int c = classify(&ops[i]);
+    s->c[c].count += 1 + ops[i].r.repeat;
+    s->c[c].bytes += (uint64_t)ops[i].r.len * (1 + ops[i].r.repeat);
+    s->c[c].bus_us += ops[i].r.dur_us;
+    if (isBusyCmd(c)) {
+      for (j = i + 1; j < n && classify(&ops[j]) == C_STATUS; j++) ;
+      if (j > i + 1) {
+        uint32_t busy = ops[j-1].r.t_us + ops[j-1].r.dur_us - (ops[i].r.t_us + ops[i].r.dur_us);
+        s->c[c].nbusy++;
+        s->c[c].busy_us += busy;
+        if (busy > s->c[c].busy_max_us) s->c[c].busy_max_us = busy;
+      }
+    }
+  }
+  if (n > 0) s->wall_us = ops[n-1].r.t_us + ops[n-1].r.dur_us - ops[0].r.t_us;
+}
+
+//
+// 전송 1개 실행
+// 반환값: 수신 데이터 hash
+//
+static uint32_t runOp(const struct op* o) {
+  const struct trace_rec* r = &o->r;
+  uint8_t* rx = (r->flags & TRACE_RX) ? _buf : NULL;
+  uint32_t len = (r->len > sizeof(_buf)) ? sizeof(_buf) : r->len;
+
+  if (r->ncmd == 0) {
+    // 단일 전송: tx 는 payload 또는 cmd[] + 0
+    if (o->tx) memcpy(_buf, o->tx, len);
+    else {
+      memset(_buf, 0, len);
+      memcpy(_buf, r->cmd, (len < TRACE_CMD_MAX) ? len : TRACE_CMD_MAX);
+    }
+    SPIDEV_transfer(_buf, rx, len, r->hz);
+  } else {
+    SPIDEV_transfer2(r->cmd, r->ncmd, r->cmd_hz, o->tx, rx, len, r->hz);
+  }
+  return rx ? TRACE_hash(rx, len) : 0;
+}
+
+//
+// WIP 가 풀릴 때까지 status read
+//
+static void waitReady(void) {
+  uint64_t t0 = UTIL_nowUs();
+  uint8_t st[2];
+  do {
+    st[0] = 0x05;
+    st[1] = 0;
+    SPIDEV_transfer(st, st, 2, 0);
+    if ((st[1] & 0x01) == 0) return;
+    usleep(20);
+  } while (UTIL_nowUs() - t0 < BUSY_TIMEOUT_US);
+  printf("Busy timeout\n");
+}
+
+//
+// trace 재생, 실제 시간으로 요약하고 수신 데이터 비교
+//
+static void replay(const struct op* ops, int n, struct summary* s) {
+  uint64_t start = UTIL_nowUs();
+  int i, j;
+
+  memset(s, 0, sizeof(*s));
+  for (i = 0; i < n; i++) {
+    const struct op* o = &ops[i];
+    int c = classify(o);
+    uint64_t t0 = UTIL_nowUs();
+    uint32_t h = runOp(o);
+    uint64_t t1;
+    uint16_t k;
+
+    for (k = 0; k < o->r.repeat; k++) runOp(o);
+    t1 = UTIL_nowUs();
+    s->c[c].count += 1 + o->r.repeat;
+    s->c[c].bytes += (uint64_t)o->r.len * (1 + o->r.repeat);
+    s->c[c].bus_us += t1 - t0;
+    if ((o->r.flags & TRACE_RX) && c != C_STATUS && h != o->r.rx_hash) {
+      if (s->mismatches < MAX_MISMATCH) printf("RX mismatch #%d: opcode %02Xh address %08x length %u\n", i, opcode(o), address(o), o->r.len);
+      s->mismatches++;
+    }
+    if (isBusyCmd(c)) {
+      for (j = i + 1; j < n && classify(&ops[j]) == C_STATUS; j++) ;
+      if (j > i + 1) {
+        uint32_t busy;
+        waitReady();
+        busy = UTIL_nowUs() - t1;
+        s->c[c].nbusy++;
+        s->c[c].busy_us += busy;
+        if (busy > s->c[c].busy_max_us) s->c[c].busy_max_us = busy;
+        i = j - 1;
+      }
+    }
+  }
+  s->wall_us = UTIL_nowUs() - start;
+}
+
+//
+// 요약 표 출력 (b 가 NULL 이면 a 만)
+//
+static void printCompare(const char* a_name, const struct summary* a, const char* b_name, const struct summary* b) {
+  int c;
+
+  printf("%-10s %8s %10s | %-25s", "", "count", "bytes", a_name);
+  if (b) printf(" | %-25s", b_name);
+  printf("\n%-10s %8s %10s | %9s %15s", "", "", "", "bus ms", "busy ms (max)");
+  if (b) printf(" | %9s %15s", "bus ms", "busy ms (max)");
+  printf("\n");
+  for (c = 0; c < NCLASS; c++) {
+    const struct cls_stat* x = &a->c[c];
+    const struct cls_stat* y = b ? &b->c[c] : x;
+    if (x->count == 0 && y->count == 0) continue;
+    printf("%-10s %8u %10llu | %9.1f %7.1f (%5.1f)", _cls_name[c], x->count,
+           (unsigned long long)x->bytes, x->bus_us / 1000.0, x->busy_us / 1000.0, x->busy_max_us / 1000.0);
+    if (b) printf(" | %9.1f %7.1f (%5.1f)", y->bus_us / 1000.0, y->busy_us / 1000.0, y->busy_max_us / 1000.0);
+    if (x->count != y->count) printf("  count %u", y->count);
+    printf("\n");
+  }
+  printf("%-10s %8s %10s | %9.1f", "wall", "", "", a->wall_us / 1000.0);
+  if (b) printf(" %15s | %9.1f", "", b->wall_us / 1000.0);
+  printf("\n");
+}
+
+static void usage(void) {
+  printf("Usage: spireplay -s a.trc | -c a.trc b.trc | [-f] a.trc\n");
+}
+
+//
+// Main program
+//
+int main(int argc, char* argv[]) {
+  struct summary a, b;
+  struct op* ops = NULL;
+  struct op* ops2 = NULL;
+  bool force = false;
+  int n, n2, c;
+  int rc = 1;
+
+  if (argc == 3 && strcmp(argv[1], "-s") == 0) {
+    if ((n = loadTrace(argv[2], &ops)) < 0) return 1;
+    summarize(ops, n, &a);
+    printf("%s: %d records\n", argv[2], n);
+    printCompare("trace", &a, NULL, NULL);
+    freeTrace(ops, n);
+    return 0;
+  }
+  if (argc == 4 && strcmp(argv[1], "-c") == 0) {
+    if ((n = loadTrace(argv[2], &ops)) < 0) return 1;
+    if ((n2 = loadTrace(argv[3], &ops2)) < 0) return 1;
+    summarize(ops, n, &a);
+    summarize(ops2, n2, &b);
+    printf("A %s: %d records, B %s: %d records\n", argv[2], n, argv[3], n2);
+    printCompare("A", &a, "B", &b);
+    freeTrace(ops, n);
+    freeTrace(ops2, n2);
+    return 0;
+  }
+  if (argc == 3 && strcmp(argv[1], "-f") == 0) force = true;
+  else if (argc != 2 || argv[1][0] == '-') {
+    usage();
+    return 1;
+  }
+
+  if ((n = loadTrace(argv[argc-1], &ops)) < 0) return 1;
+  summarize(ops, n, &a);
+#ifndef SPI_SIM
+  for (c = 0; c < NCLASS && !force; c++) {
+    if (isBusyCmd(c) && a.c[c].count) {
+      printf("Trace programs or erases the flash, use -f to replay on hardware\n");
+      freeTrace(ops, n);
+      return 1;
+    }
+  }
+  if (!BOARD_open(GPIO_CHIP)) goto end_trace;
+#endif
+  (void)c; (void)force;
+  if (!SPIDEV_open(SPI_DEVICE, SPI_MODE, SPI_SPEED_HZ)) goto end_board;
+
+#ifndef SPI_SIM
+  BOARD_bypassEnable();
+#endif
+  replay(ops, n, &b);
+#ifndef SPI_SIM
+  printf("FPGA offline %u ms\n", BOARD_bypassDisable());
+#endif
+  SPIDEV_close();
+
+  printf("%s: %d records, %u RX mismatches\n", argv[argc-1], n, b.mismatches);
+  printCompare("trace", &a, "replay", &b);
+  rc = b.mismatches ? 1 : 0;
+
+end_board:
+#ifndef SPI_SIM
+  BOARD_close();
+end_trace:
+#endif
+  freeTrace(ops, n);
+  return rc;
+}
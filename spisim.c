@@ -0,0 +1,156 @@
+//
+// Simulated IS25LP256 behind the spidev API (spidev.h), for replaying traces at the desk
+//
+// 32MB in RAM (0xFF, or loaded from SPISIM_IMAGE), JEDEC ID 9D 60 19.
+// Read (03h/0Bh/13h/0Ch), page program (02h/12h), erase (20h/21h, 52h/5Ch, D8h/DCh, C7h/60h),
+// WREN/WRDI, RDSR, RDJDID, RDUID. Other commands return 0xFF.
+// Program and erase keep WIP set for the datasheet typical time, bus time is not simulated.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "spidev.h"
+#include "util.h"
+
+#define SIM_SIZE      (32 * 1024 * 1024)
+#define SIM_BUFSIZ    4096
+#define SIM_T_PP_US   200           // typical page program time
+#define SIM_T_SE_US   70000         // typical 4KB erase time
+#define SIM_T_BE32_US 100000
+#define SIM_T_BE64_US 150000
+#define SIM_T_CE_US   45000000
+
+static uint8_t* _mem;
+static bool _wel;
+static uint64_t _busy_until;        // WIP is set until this time (us)
+
+static uint32_t addrOf(const uint8_t* p, uint8_t abytes) {
+  uint32_t a = 0;
+  uint8_t i;
+  for (i = 0; i < abytes; i++) a = (a << 8) | p[i];
+  return a % SIM_SIZE;
+}
+
+static uint8_t addrBytes(uint8_t op) {
+  switch (op) {
+  case 0x13: case 0x0C: case 0x12: case 0x21: case 0x5C: case 0xDC: return 4;
+  default: return 3;
+  }
+}
+
+//
+// 명령 실행
+// cmd(in) : 명령, 주소 (n 바이트)
+// tx(in)  : 데이터 (page program), rx(out) : 읽은 데이터, len: 데이터 바이트
+//
+static void execute(const uint8_t* cmd, uint32_t n, const uint8_t* tx, uint8_t* rx, uint32_t len) {
+  uint8_t op = cmd[0];
+  uint8_t ab = addrBytes(op);
+  bool busy = UTIL_nowUs() < _busy_until;
+  uint32_t a = (n > ab) ? addrOf(&cmd[1], ab) : 0;
+  uint32_t i, size = 0, t_us = 0;
+
+  if (rx) memset(rx, 0xFF, len);
+  switch (op) {
+  case 0x05:                                            // RDSR
+    if (rx) memset(rx, (busy ? 0x01 : 0x00) | (_wel ? 0x02 : 0x00), len);
+    return;
+  case 0x9F:                                            // RDJDID
+    if (rx && len >= 3) { rx[0] = 0x9D; rx[1] = 0x60; rx[2] = 0x19; }
+    return;
+  case 0x4B:                                            // RDUID
+    if (rx) for (i = 0; i < len; i++) rx[i] = (uint8_t)i;
+    return;
+  case 0x81:                                            // RDERP (error flags, never set)
+    if (rx) memset(rx, 0x00, len);
+    return;
+  case 0x82:                                            // CLERP
+    return;
+  }
+  if (busy) return;                                     // 동작 중에는 다른 명령 무시
+  switch (op) {
+  case 0x06: _wel = true; return;
+  case 0x04: _wel = false; return;
+  case 0x03: case 0x13: case 0x0B: case 0x0C:           // read
+    if (rx) for (i = 0; i < len; i++) rx[i] = _mem[(a + i) % SIM_SIZE];
+    return;
+  case 0x02: case 0x12:                                 // page program (page 안에서 wrap)
+    if (!_wel || tx == NULL) return;
+    for (i = 0; i < len; i++) _mem[(a & ~0xFFu) | ((a + i) & 0xFF)] &= tx[i];
+    _wel = false;
+    _busy_until = UTIL_nowUs() + SIM_T_PP_US;
+    return;
+  case 0x20: case 0x21: size = 4096;  t_us = SIM_T_SE_US;   break;
+  case 0x52: case 0x5C: size = 32768; t_us = SIM_T_BE32_US; break;
+  case 0xD8: case 0xDC: size = 65536; t_us = SIM_T_BE64_US; break;
+  case 0xC7: case 0x60: size = SIM_SIZE; a = 0; t_us = SIM_T_CE_US; break;
+  default: return;
+  }
+  if (!_wel) return;
+  a &= ~(size - 1);
+  memset(&_mem[a], 0xFF, size);
+  _wel = false;
+  _busy_until = UTIL_nowUs() + t_us;
+}
+
+bool SPIDEV_open(const char* dev, uint8_t mode, uint32_t speed_hz) {
+  const char* image = getenv("SPISIM_IMAGE");
+  (void)dev; (void)mode; (void)speed_hz;
+
+  _mem = (uint8_t*)malloc(SIM_SIZE);
+  if (_mem == NULL) return false;
+  memset(_mem, 0xFF, SIM_SIZE);
+  if (image) {
+    FILE* fp = fopen(image, "rb");
+    if (fp == NULL) {
+      perror("SPISIM_IMAGE");
+      return false;
+    }
+    printf("Simulated flash loaded %zu bytes from %s\n", fread(_mem, 1, SIM_SIZE, fp), image);
+    fclose(fp);
+  }
+  return true;
+}
+
+void SPIDEV_close(void) {
+  free(_mem);
+  _mem = NULL;
+}
+
+uint32_t SPIDEV_maxTransfer(void) {
+  return SIM_BUFSIZ;
+}
+
+int SPIDEV_transfer(const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t speed_hz) {
+  uint8_t cmd[8];
+  uint8_t* data;
+  uint32_t ncmd;
+  (void)speed_hz;
+
+  if (n == 0 || tx == NULL) return (int)n;
+  // 단일 전송: 명령+주소 뒤에 오는 부분이 데이터 (RDSR, RDJDID 는 1 바이트 명령)
+  ncmd = (tx[0] == 0x05 || tx[0] == 0x9F || tx[0] == 0x06 || tx[0] == 0x04 || tx[0] == 0xC7 || tx[0] == 0x60) ? 1 : 1 + addrBytes(tx[0]);
+  if (tx[0] == 0x4B) ncmd = 5;                         // RDUID: 명령 + 주소 3 + dummy 1
+  if (ncmd > n) ncmd = n;
+  memcpy(cmd, tx, ncmd);
+  data = (uint8_t*)malloc(n - ncmd + 1);
+  if (data == NULL) return -1;
+  execute(cmd, ncmd, &tx[ncmd], data, n - ncmd);
+  if (rx) {
+    memset(rx, 0xFF, ncmd);
+    memcpy(&rx[ncmd], data, n - ncmd);
+  }
+  free(data);
+  return (int)n;
+}
+
+int SPIDEV_transfer2(const uint8_t* cmd, uint32_t ncmd, uint32_t cmd_hz,
+                     const uint8_t* tx, uint8_t* rx, uint32_t n, uint32_t data_hz) {
+  (void)cmd_hz; (void)data_hz;
+  if (ncmd == 0) return 0;
+  execute(cmd, ncmd, tx, rx, n);
+  return (int)(ncmd + n);
+}
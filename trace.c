@@ -0,0 +1,126 @@
+//
+// SPI transaction trace recorder
+// Called by spidev.c around each ioctl, only when tracing is enabled.
+// The last record is held back, so identical status polls can be merged into it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "trace.h"
+#include "util.h"
+
+static FILE* _fp;
+static uint64_t _t0;                 // start of trace (us)
+static uint64_t _ts;                 // start of current transfer (us)
+static struct trace_rec _rec;        // current transfer
+static struct trace_rec _last;       // record not yet written (no payload)
+static bool _has_last;
+static uint8_t* _tx;                 // copy of tx data of current transfer
+static uint32_t _txsize;
+
+uint32_t TRACE_hash(const uint8_t* p, uint32_t n) {
+  uint32_t h = 2166136261u;
+  while (n--) {
+    h ^= *p++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+bool TRACE_open(const char* path) {
+  struct trace_header hdr;
+
+  _fp = fopen(path, "wb");
+  if (_fp == NULL) {
+    perror("TRACE_open");
+    return false;
+  }
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+  hdr.version = TRACE_VERSION;
+  hdr.rec_size = sizeof(struct trace_rec);
+  fwrite(&hdr, sizeof(hdr), 1, _fp);
+  _t0 = UTIL_nowUs();
+  printf("SPI trace: %s\n", path);
+  return true;
+}
+
+static void flushLast(void) {
+  if (_has_last) fwrite(&_last, sizeof(_last), 1, _fp);
+  _has_last = false;
+}
+
+void TRACE_close(void) {
+  if (_fp) {
+    flushLast();
+    fclose(_fp);
+  }
+  _fp = NULL;
+  free(_tx);
+  _tx = NULL;
+  _txsize = 0;
+}
+
+//
+// 전송 전: 명령과 tx 데이터 보관 (tx 와 rx 가 같은 버퍼일 수 있으므로 먼저 복사)
+//
+void TRACE_begin(const uint8_t* cmd, uint32_t ncmd, const uint8_t* tx, uint32_t n) {
+  if (_fp == NULL) return;
+
+  memset(&_rec, 0, sizeof(_rec));
+  _rec.len = n;
+  _rec.ncmd = (ncmd > TRACE_CMD_MAX) ? TRACE_CMD_MAX : ncmd;
+  if (ncmd) memcpy(_rec.cmd, cmd, _rec.ncmd);
+  else if (tx) memcpy(_rec.cmd, tx, (n < TRACE_CMD_MAX) ? n : TRACE_CMD_MAX);
+
+  // 단일 전송은 cmd[] 에 다 들어가지 않을 때만 payload 로 남긴다
+  if (tx && (ncmd || n > TRACE_CMD_MAX)) {
+    if (n > _txsize) {
+      free(_tx);
+      _tx = (uint8_t*)malloc(n);
+      _txsize = _tx ? n : 0;
+    }
+    if (_tx) {
+      memcpy(_tx, tx, n);
+      _rec.flags |= TRACE_TX;
+    }
+  }
+  _ts = UTIL_nowUs();
+}
+
+//
+// 전송 후: 시간, 수신 데이터 hash 기록
+//
+void TRACE_end(const uint8_t* rx, uint32_t cmd_hz, uint32_t hz, bool ok) {
+  if (_fp == NULL) return;
+
+  _rec.dur_us = (uint32_t)(UTIL_nowUs() - _ts);
+  _rec.t_us = (uint32_t)(_ts - _t0);
+  _rec.cmd_hz = cmd_hz;
+  _rec.hz = hz;
+  if (rx) {
+    _rec.flags |= TRACE_RX;
+    _rec.rx_hash = TRACE_hash(rx, _rec.len);
+  }
+  if (!ok) _rec.flags |= TRACE_ERR;
+
+  // 앞의 record 와 같은 전송이면 (status polling) 합친다
+  if (_has_last && !(_rec.flags & TRACE_TX) && _last.repeat < 0xFFFF && _last.ncmd == _rec.ncmd &&
+      _last.len == _rec.len && _last.hz == _rec.hz && _last.flags == _rec.flags && _last.rx_hash == _rec.rx_hash &&
+      memcmp(_last.cmd, _rec.cmd, TRACE_CMD_MAX) == 0) {
+    _last.repeat++;
+    _last.dur_us = _rec.t_us + _rec.dur_us - _last.t_us;
+    return;
+  }
+  flushLast();
+  if (_rec.flags & TRACE_TX) {
+    fwrite(&_rec, sizeof(_rec), 1, _fp);
+    fwrite(_tx, 1, _rec.len, _fp);
+  } else {
+    _last = _rec;
+    _has_last = true;
+  }
+}
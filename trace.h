@@ -0,0 +1,53 @@
+//
+// SPI transaction trace (*.trc)
+//
+// Every spidev transfer is recorded when the environment variable SPI_TRACE names a trace file:
+//    sudo SPI_TRACE=/tmp/update.trc ./main
+// File layout (little endian)
+//    struct trace_header
+//    struct trace_rec [+ tx payload (len byte) if TRACE_TX]  x  number of records
+// Identical consecutive transfers without payload (status polling) are merged into one record.
+// Replayed and compared by spireplay.
+//
+
+#define TRACE_MAGIC     "SPITRC1"
+#define TRACE_VERSION   1
+#define TRACE_CMD_MAX   8
+
+#define TRACE_TX        0x01     // tx payload (len byte) follows the record
+#define TRACE_RX        0x02     // data was received, rx_hash is valid
+#define TRACE_ERR       0x04     // ioctl failed
+
+struct trace_header {
+  char     magic[8];             // TRACE_MAGIC
+  uint32_t version;              // TRACE_VERSION
+  uint32_t rec_size;             // sizeof(struct trace_rec)
+};
+
+struct trace_rec {
+  uint32_t t_us;                 // start of transfer from start of trace
+  uint32_t dur_us;               // duration of transfer (ioctl), merged: first start to last end
+  uint32_t len;                  // data bytes (ncmd 0: whole transfer)
+  uint32_t rx_hash;              // FNV-1a of received data
+  uint32_t cmd_hz;               // clock of command phase (0: default)
+  uint32_t hz;                   // clock of data phase, or of whole transfer (0: default)
+  uint8_t  ncmd;                 // command bytes (0: single transfer, cmd[] holds its first bytes)
+  uint8_t  flags;                // TRACE_TX, TRACE_RX, TRACE_ERR
+  uint16_t repeat;               // number of identical transfers merged into this record - 1
+  uint8_t  cmd[TRACE_CMD_MAX];   // opcode, address, dummy
+};
+
+// Open trace file for recording. Return: true:success false:failure
+bool TRACE_open(const char* path);
+
+// Close trace file
+void TRACE_close(void);
+
+// Before a transfer: keep command and tx data (tx and rx may be the same buffer), start timer
+void TRACE_begin(const uint8_t* cmd, uint32_t ncmd, const uint8_t* tx, uint32_t n);
+
+// After a transfer: write record with duration and hash of received data
+void TRACE_end(const uint8_t* rx, uint32_t cmd_hz, uint32_t hz, bool ok);
+
+// FNV-1a 32bit hash
+uint32_t TRACE_hash(const uint8_t* p, uint32_t n);
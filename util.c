@@ -0,0 +1,61 @@
+//
+// Small helpers shared by the command line tools
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "util.h"
+
+uint8_t* UTIL_readFile(const char* path, uint32_t* size) {
+  FILE* fp = fopen(path, "rb");
+  uint8_t* buf = NULL;
+  long n;
+
+  if (fp == NULL) {
+    perror(path);
+    return NULL;
+  }
+  if (fseek(fp, 0, SEEK_END) < 0 || (n = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) < 0) {
+    perror(path);
+    fclose(fp);
+    return NULL;
+  }
+  if (n > UINT32_MAX - 1) {               // 디렉터리도 여기 (ftell 이 LONG_MAX)
+    printf("%s: not a regular file or larger than 4GB\n", path);
+    fclose(fp);
+    return NULL;
+  }
+  *size = n;
+  buf = (uint8_t*)malloc(*size + 1);
+  if (buf == NULL || fread(buf, 1, *size, fp) != *size) {
+    perror(path);
+    fclose(fp);
+    free(buf);
+    return NULL;
+  }
+  fclose(fp);
+  return buf;
+}
+
+uint32_t UTIL_elapsedUs(const struct timespec* t0) {
+  struct timespec t1;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) * 1000000 + (t1.tv_nsec - t0->tv_nsec) / 1000;
+}
+
+uint64_t UTIL_nowUs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+bool UTIL_stateDir(void) {
+  if (mkdir(UTIL_STATE_DIR, 0755) == 0 || errno == EEXIST) return true;
+  perror(UTIL_STATE_DIR);
+  return false;
+}
@@ -0,0 +1,21 @@
+//
+// Small helpers shared by the command line tools (no SPI/GPIO, host tools link it too)
+//
+
+struct timespec;
+
+// Read a whole file into a malloc'ed buffer (one spare byte at the end), size(out): file size
+// Return: buffer (free by caller) or NULL on error (reported by perror)
+uint8_t* UTIL_readFile(const char* path, uint32_t* size);
+
+// Microseconds since t0 (CLOCK_MONOTONIC)
+uint32_t UTIL_elapsedUs(const struct timespec* t0);
+
+// CLOCK_MONOTONIC in microseconds (time stamps and intervals longer than 71 minutes)
+uint64_t UTIL_nowUs(void);
+
+// Directory of state kept across runs (scrubber baseline, patch journal)
+#define UTIL_STATE_DIR "/var/lib/spiflash"
+
+// Create UTIL_STATE_DIR if it does not exist. Return: true:exists false:failure (reported by perror)
+bool UTIL_stateDir(void);